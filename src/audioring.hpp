@@ -0,0 +1,166 @@
+/**
+ * SUZUKI PLAN - TinyMSX - Lock-free audio ring buffer
+ * -----------------------------------------------------------------------------
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Yoji Suzuki.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * -----------------------------------------------------------------------------
+ */
+#ifndef INCLUDE_AUDIORING_HPP
+#define INCLUDE_AUDIORING_HPP
+
+#include <atomic>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Single producer (emulator thread) and single consumer (audio thread) ring buffer.
+ * The indices count the sample frames (a frame = all channels of a sample) and never wrap in use
+ * (unsigned arithmetic), the buffer position is index & mask.
+ * The producer keeps at most `latency` frames in the ring; the rest is dropped and counted as an overrun.
+ * The consumer gets silence for the missing frames and it is counted as an underrun.
+ */
+class AudioRing
+{
+  private:
+    unsigned char* buffer;
+    size_t frameSize; // bytes per frame
+    unsigned int mask;
+    unsigned int latency;
+    std::atomic<unsigned int> writeIndex;
+    std::atomic<unsigned int> readIndex;
+    std::atomic<unsigned int> underruns;
+    std::atomic<unsigned int> overruns;
+
+  public:
+    AudioRing()
+    {
+        this->buffer = NULL;
+        this->frameSize = 0;
+        this->mask = 0;
+        this->latency = 0;
+        this->clear();
+    }
+
+    ~AudioRing() { this->release(); }
+
+    /**
+     * Allocate the ring (call it while the consumer is stopped)
+     * - latency: maximum number of the buffered frames (the ring capacity is the next power of two)
+     * - frameSize: bytes per frame (e.g. 4 = int16 stereo)
+     */
+    bool setup(unsigned int latency, size_t frameSize)
+    {
+        this->release();
+        if (latency < 1 || 0x100000 < latency || frameSize < 1) return false;
+        unsigned int capacity = 1;
+        while (capacity < latency) capacity <<= 1;
+        this->buffer = (unsigned char*)malloc(capacity * frameSize);
+        if (!this->buffer) return false;
+        this->frameSize = frameSize;
+        this->mask = capacity - 1;
+        this->latency = latency;
+        this->clear();
+        return true;
+    }
+
+    void release()
+    {
+        if (this->buffer) free(this->buffer);
+        this->buffer = NULL;
+        this->mask = 0;
+        this->latency = 0;
+    }
+
+    void clear()
+    {
+        this->writeIndex.store(0);
+        this->readIndex.store(0);
+        this->underruns.store(0);
+        this->overruns.store(0);
+    }
+
+    inline bool isEnabled() { return NULL != this->buffer; }
+    inline size_t getFrameSize() { return this->frameSize; }
+    inline unsigned int getLatency() { return this->latency; }
+    inline unsigned int getUnderruns() { return this->underruns.load(std::memory_order_relaxed); }
+    inline unsigned int getOverruns() { return this->overruns.load(std::memory_order_relaxed); }
+
+    // number of the buffered frames (either side)
+    inline unsigned int getLevel()
+    {
+        return this->writeIndex.load(std::memory_order_acquire) - this->readIndex.load(std::memory_order_acquire);
+    }
+
+    // producer side: returns the number of the written frames
+    unsigned int write(const void* data, unsigned int frames)
+    {
+        if (!this->buffer) return 0;
+        unsigned int w = this->writeIndex.load(std::memory_order_relaxed);
+        unsigned int r = this->readIndex.load(std::memory_order_acquire);
+        unsigned int space = this->latency - (w - r);
+        if (space < frames) {
+            this->overruns.fetch_add(1, std::memory_order_relaxed);
+            frames = space;
+        }
+        this->copy(&this->buffer[(w & this->mask) * this->frameSize], data, frames, true);
+        this->writeIndex.store(w + frames, std::memory_order_release);
+        return frames;
+    }
+
+    // consumer side: fills all frames (silence for the missing frames) and returns the number of the read frames
+    unsigned int read(void* data, unsigned int frames)
+    {
+        if (!this->buffer) return 0;
+        unsigned int r = this->readIndex.load(std::memory_order_relaxed);
+        unsigned int w = this->writeIndex.load(std::memory_order_acquire);
+        unsigned int available = w - r;
+        unsigned int count = available < frames ? available : frames;
+        this->copy(data, &this->buffer[(r & this->mask) * this->frameSize], count, false);
+        this->readIndex.store(r + count, std::memory_order_release);
+        if (count < frames) {
+            memset((unsigned char*)data + count * this->frameSize, 0, (frames - count) * this->frameSize);
+            this->underruns.fetch_add(1, std::memory_order_relaxed);
+        }
+        return count;
+    }
+
+  private:
+    // copy with the wrap around at the end of the ring
+    inline void copy(void* dst, const void* src, unsigned int frames, bool toRing)
+    {
+        unsigned char* ring = toRing ? (unsigned char*)dst : (unsigned char*)src;
+        unsigned int head = (unsigned int)((ring - this->buffer) / this->frameSize);
+        unsigned int first = this->mask + 1 - head;
+        if (frames < first) first = frames;
+        memcpy(dst, src, first * this->frameSize);
+        if (first < frames) {
+            size_t rest = (frames - first) * this->frameSize;
+            if (toRing) {
+                memcpy(this->buffer, (const unsigned char*)src + first * this->frameSize, rest);
+            } else {
+                memcpy((unsigned char*)dst + first * this->frameSize, this->buffer, rest);
+            }
+        }
+    }
+};
+
+#endif // INCLUDE_AUDIORING_HPP
@@ -29,17 +29,20 @@
 #define INCLUDE_AY8910_HPP
 
 #include <string.h>
+#include "blipbuf.hpp"
+#include "vgmlogger.hpp"
 
 class AY8910
 {
   private:
-    unsigned int clock;
     unsigned char regMask[16];
     unsigned int levels[32];
+    int output; // the last output level added to the blip buffer
+    VgmLogger* vgm;
 
   public:
     struct Context {
-        int bobo;
+        unsigned int time; // clocks from the start of the current frame
         unsigned char latch;
         unsigned char reg[16];
         unsigned int tPeriod[3];
@@ -54,13 +57,23 @@ class AY8910
         int eFace;
         unsigned int eHolding;
         unsigned int random;
-        int mix[3];
     } ctx;
 
+    AY8910() { this->vgm = NULL; }
+
+    // log the register writes (NULL: disable)
+    inline void setVgmLogger(VgmLogger* vgm) { this->vgm = vgm; }
+
     void reset(int gain)
     {
         memset(&this->ctx, 0, sizeof(this->ctx));
-        this->ctx.ePeriod = 1;
+        this->ctx.tUp[0] = 1;
+        this->ctx.tUp[1] = 1;
+        this->ctx.tUp[2] = 1;
+        this->ctx.nPeriod = 16;
+        this->ctx.nCounter = 16;
+        this->ctx.ePeriod = 16;
+        this->ctx.eCounter = 16;
         this->ctx.eFace = 1;
         this->ctx.random = 0xFFFF;
         this->ctx.reg[7] = 0x80;
@@ -70,6 +83,7 @@ class AY8910
         unsigned int levels[32] = {0, 1, 1, 1, 2, 2, 3, 4, 5, 6, 7, 9, 10, 12, 15, 18, 22, 26, 31, 37, 44, 53, 63, 75, 90, 107, 127, 151, 180, 214, 255, 255};
         memcpy(this->levels, levels, sizeof(this->levels));
         for (int i = 0; i < 32; i++) this->levels[i] *= gain;
+        this->output = 0;
     }
 
     inline void latch(unsigned char value) { this->ctx.latch = value & 0x0F; }
@@ -83,27 +97,42 @@ class AY8910
         this->ctx.reg[0x0F] = ~pad2;
     }
 
+    // NOTE: call run() with the current time before write() to apply the change at the exact timing
     inline void write(unsigned char value)
     {
+        if (this->vgm && this->ctx.latch < 14) this->vgm->writeAY8910(this->ctx.time, this->ctx.latch, value);
         this->ctx.reg[this->ctx.latch] = value & this->regMask[this->ctx.latch];
         switch (this->ctx.latch) {
-            case 0: this->ctx.tPeriod[0] = (this->ctx.tPeriod[0] & 0xF000) | (value << 4); break;
-            case 1: this->ctx.tPeriod[0] = (this->ctx.tPeriod[0] & 0x0FF0) | (value << 12); break;
-            case 2: this->ctx.tPeriod[1] = (this->ctx.tPeriod[1] & 0xF000) | (value << 4); break;
-            case 3: this->ctx.tPeriod[1] = (this->ctx.tPeriod[1] & 0x0FF0) | (value << 12); break;
-            case 4: this->ctx.tPeriod[2] = (this->ctx.tPeriod[2] & 0xF000) | (value << 4); break;
-            case 5: this->ctx.tPeriod[2] = (this->ctx.tPeriod[2] & 0x0FF0) | (value << 12); break;
-            case 6: this->ctx.nPeriod = value << 4; break;
-            case 11:
-                this->ctx.ePeriod = this->ctx.ePeriod & 0xFF000;
-                this->ctx.ePeriod |= value << 4;
-                this->ctx.ePeriod = this->ctx.ePeriod ? this->ctx.ePeriod : 1;
+            case 0:
+            case 1:
+            case 2:
+            case 3:
+            case 4:
+            case 5: {
+                int ch = this->ctx.latch >> 1;
+                unsigned int period = (this->ctx.reg[ch * 2] | this->ctx.reg[ch * 2 + 1] << 8) << 4;
+                if (period) {
+                    this->ctx.tCounter[ch] = this->ctx.tPeriod[ch] ? this->changePeriod(this->ctx.tCounter[ch], this->ctx.tPeriod[ch], period) : period;
+                } else {
+                    this->ctx.tUp[ch] = 1; // stay high (used for the PCM playback with the volume register)
+                }
+                this->ctx.tPeriod[ch] = period;
                 break;
-            case 12:
-                this->ctx.ePeriod = this->ctx.ePeriod & 0x00FF0;
-                this->ctx.ePeriod |= value << 12;
-                this->ctx.ePeriod = this->ctx.ePeriod ? this->ctx.ePeriod : 1;
+            }
+            case 6: {
+                unsigned int period = this->ctx.reg[6] ? this->ctx.reg[6] << 4 : 16;
+                this->ctx.nCounter = this->changePeriod(this->ctx.nCounter, this->ctx.nPeriod, period);
+                this->ctx.nPeriod = period;
                 break;
+            }
+            case 11:
+            case 12: {
+                unsigned int period = (this->ctx.reg[11] | this->ctx.reg[12] << 8) << 4;
+                period = period ? period : 16;
+                this->ctx.eCounter = this->changePeriod(this->ctx.eCounter, this->ctx.ePeriod, period);
+                this->ctx.ePeriod = period;
+                break;
+            }
             case 13:
                 if (value & 0b0100) {
                     this->ctx.eFace = 1;
@@ -113,70 +142,99 @@ class AY8910
                     this->ctx.eState = 0x1F;
                 }
                 this->ctx.eHolding = 1;
+                this->ctx.eCounter = this->ctx.ePeriod;
                 break;
         }
     }
 
-    inline void tick(short* left, short* right, unsigned int cycles)
+    /**
+     * Execute until the time (clocks from the start of the current frame) with the event stepping.
+     * Tone toggles, noise shifts and envelope steps are processed at their exact clock,
+     * and the output level changes are added to the blip buffer.
+     */
+    inline void run(BlipBuffer* blip, unsigned int time)
     {
-        if (this->ctx.eHolding) {
-            this->ctx.eCounter += cycles;
-            while (0 < this->ctx.eCounter) {
-                this->ctx.eCounter -= this->ctx.ePeriod;
-                this->ctx.eState += this->ctx.eFace;
-                if (this->ctx.eState & 0b00100000) {
-                    switch (this->ctx.reg[13]) {
-                        case 8:
-                        case 12:
-                            this->ctx.eState = this->ctx.eFace == 1 ? 0 : 0x1F;
-                            break;
-                        case 10:
-                        case 14:
-                            this->ctx.eFace = -this->ctx.eFace;
-                            this->ctx.eState = this->ctx.eFace == 1 ? 0 : 0x1F;
-                            break;
-                        case 11:
-                        case 15:
-                            this->ctx.eState = this->ctx.eFace == 1 ? 0 : 0x1F;
-                            this->ctx.eHolding = 1;
-                            this->ctx.eCounter = 0;
-                            break;
-                        case 9:
-                        case 13:
-                            this->ctx.eFace = -this->ctx.eFace;
-                            this->ctx.eState = this->ctx.eFace == 1 ? 0 : 0x1F;
-                            this->ctx.eHolding = 1;
-                            this->ctx.eCounter = 0;
-                            break;
-                        default:
-                            this->ctx.eState = 0;
-                            this->ctx.eHolding = 1;
-                            this->ctx.eCounter = 0;
+        this->updateOutput(blip);
+        while (this->ctx.time < time) {
+            int step = (int)(time - this->ctx.time);
+            for (int ch = 0; ch < 3; ch++) {
+                if (this->ctx.tPeriod[ch] && this->ctx.tCounter[ch] < step) step = this->ctx.tCounter[ch];
+            }
+            if (this->ctx.nCounter < step) step = this->ctx.nCounter;
+            if (this->ctx.eHolding && this->ctx.eCounter < step) step = this->ctx.eCounter;
+            this->ctx.time += step;
+            for (int ch = 0; ch < 3; ch++) {
+                if (this->ctx.tPeriod[ch]) {
+                    this->ctx.tCounter[ch] -= step;
+                    if (0 == this->ctx.tCounter[ch]) {
+                        this->ctx.tCounter[ch] = this->ctx.tPeriod[ch];
+                        this->ctx.tUp[ch] ^= 1;
                     }
                 }
             }
-        }
-        if (this->ctx.nPeriod) {
-            this->ctx.nCounter += cycles;
-            while (0 <= this->ctx.nCounter) {
-                this->ctx.nCounter -= this->ctx.nPeriod;
+            this->ctx.nCounter -= step;
+            if (0 == this->ctx.nCounter) {
+                this->ctx.nCounter = this->ctx.nPeriod;
                 this->ctx.nUp = this->getRandom();
             }
-        } else {
-            this->ctx.nUp = this->getRandom();
+            if (this->ctx.eHolding) {
+                this->ctx.eCounter -= step;
+                if (0 == this->ctx.eCounter) {
+                    this->ctx.eCounter = this->ctx.ePeriod;
+                    this->stepEnvelope();
+                }
+            }
+            this->updateOutput(blip);
         }
-        int mix = this->getOutputMix(0, this->ctx.reg[7], cycles);
-        mix += this->getOutputMix(1, this->ctx.reg[7] >> 1, cycles);
-        mix += this->getOutputMix(2, this->ctx.reg[7] >> 2, cycles);
-        if (32767 < mix)
-            mix = 32767;
-        else if (mix < -32768)
-            mix = -32768;
-        *left = (short)mix;
-        *right = *left;
+    }
+
+    // execute until the end of the frame, and the next frame starts from time 0
+    inline void endFrame(BlipBuffer* blip, unsigned int time)
+    {
+        this->run(blip, time);
+        this->ctx.time -= time;
     }
 
   private:
+    // keep the elapsed clocks of the current period when the period was changed
+    inline int changePeriod(int counter, unsigned int oldPeriod, unsigned int newPeriod)
+    {
+        int elapsed = (int)oldPeriod - counter;
+        return elapsed < (int)newPeriod ? (int)newPeriod - elapsed : 1;
+    }
+
+    inline void stepEnvelope()
+    {
+        this->ctx.eState += this->ctx.eFace;
+        if (this->ctx.eState & 0b00100000) {
+            switch (this->ctx.reg[13]) {
+                case 8:
+                case 12:
+                    this->ctx.eState = this->ctx.eFace == 1 ? 0 : 0x1F;
+                    break;
+                case 10:
+                case 14:
+                    this->ctx.eFace = -this->ctx.eFace;
+                    this->ctx.eState = this->ctx.eFace == 1 ? 0 : 0x1F;
+                    break;
+                case 11:
+                case 15:
+                    this->ctx.eState = this->ctx.eFace == 1 ? 0 : 0x1F;
+                    this->ctx.eHolding = 0;
+                    break;
+                case 9:
+                case 13:
+                    this->ctx.eFace = -this->ctx.eFace;
+                    this->ctx.eState = this->ctx.eFace == 1 ? 0 : 0x1F;
+                    this->ctx.eHolding = 0;
+                    break;
+                default:
+                    this->ctx.eState = 0;
+                    this->ctx.eHolding = 0;
+            }
+        }
+    }
+
     inline int getRandom()
     {
         if (this->ctx.random & 1) {
@@ -189,25 +247,20 @@ class AY8910
         }
     }
 
-    inline int getOutputMix(int ch, unsigned int mask, unsigned int cycles)
+    inline void updateOutput(BlipBuffer* blip)
     {
-        unsigned int volume;
-        int mix = this->ctx.mix[ch];
-        if (this->ctx.tPeriod[ch]) {
-            this->ctx.tCounter[ch] += cycles;
-            while (0 <= this->ctx.tCounter[ch]) {
-                this->ctx.tCounter[ch] -= this->ctx.tPeriod[ch];
-                this->ctx.tUp[ch] ^= 1;
+        int mix = 0;
+        unsigned int mask = this->ctx.reg[7];
+        for (int ch = 0; ch < 3; ch++, mask >>= 1) {
+            if (((mask & 0x01) || this->ctx.tUp[ch]) && ((mask & 0x08) || this->ctx.nUp)) {
+                unsigned int volume = this->ctx.reg[8 + ch] << 1;
+                mix += volume & 0x20 ? this->levels[this->ctx.eState] : this->levels[volume & 0x1F];
             }
-        } else
-            this->ctx.tUp[ch] = 1;
-        if (((mask & 0x01) || this->ctx.tUp[ch]) && ((mask & 0x08) || this->ctx.nUp)) {
-            volume = this->ctx.reg[8 + ch] << 1;
-            this->ctx.mix[ch] = volume & 0x20 ? this->levels[this->ctx.eState] : this->levels[volume & 0x1F];
-        } else {
-            this->ctx.mix[ch] >>= 1;
         }
-        return (mix + this->ctx.mix[ch]) >> 1;
+        if (mix != this->output) {
+            blip->addDelta(this->ctx.time, mix - this->output);
+            this->output = mix;
+        }
     }
 };
 
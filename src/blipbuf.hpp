@@ -0,0 +1,234 @@
+/**
+ * SUZUKI PLAN - TinyMSX - Band-limited delta buffer
+ * -----------------------------------------------------------------------------
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Yoji Suzuki.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * -----------------------------------------------------------------------------
+ */
+#ifndef INCLUDE_BLIPBUF_HPP
+#define INCLUDE_BLIPBUF_HPP
+
+#include <math.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define BLIP_PHASE_BITS 6
+#define BLIP_PHASES (1 << BLIP_PHASE_BITS)
+#define BLIP_KERNEL_SIZE 16
+#define BLIP_UNIT_BITS 14
+#define BLIP_BUFFER_SIZE 4096 // enough for a frame at 192kHz
+
+/**
+ * The sound chips add the amplitude changes (deltas) at the exact clock time,
+ * and each delta is stored as a band-limited impulse (windowed sinc).
+ * The samples are produced by integrating the buffer once at the frame end.
+ * Clock time to sample position conversion is exact (integer rational: sampleRate / clockRate).
+ */
+class BlipBuffer
+{
+  private:
+    const short (*kernel)[BLIP_KERNEL_SIZE]; // unit: 1 << BLIP_UNIT_BITS (shared by all instances)
+    unsigned int clockRate;
+    unsigned int sampleRate;
+    unsigned int remainder; // sub-sample position of the frame start (unit: 1 / clockRate sample)
+    unsigned long long factor; // samples per clock (32.32 fixed point)
+    unsigned long long offset; // remainder in 32.32 fixed point
+    int available;
+    int integrator;
+    int buffer[BLIP_BUFFER_SIZE + BLIP_KERNEL_SIZE];
+
+  public:
+    BlipBuffer()
+    {
+        this->kernel = getKernel();
+        this->setRates(1, 1);
+    }
+
+    void setRates(unsigned int clockRate, unsigned int sampleRate)
+    {
+        this->clockRate = clockRate ? clockRate : 1;
+        this->sampleRate = sampleRate;
+        this->factor = ((unsigned long long)sampleRate << 32) / this->clockRate;
+        this->clear();
+    }
+
+    void clear()
+    {
+        this->remainder = 0;
+        this->offset = 0;
+        this->available = 0;
+        this->integrator = 0;
+        memset(this->buffer, 0, sizeof(this->buffer));
+    }
+
+    inline unsigned int getSampleRate() { return this->sampleRate; }
+    inline int getAvailable() { return this->available; }
+
+    // time: clocks from the start of the current frame
+    // (the position is 32.32 fixed point; the error is far less than a phase and does not accumulate)
+    inline void addDelta(unsigned int time, int delta)
+    {
+        unsigned long long x = time * this->factor + this->offset;
+        unsigned long long index = this->available + (x >> 32);
+        if (BLIP_BUFFER_SIZE <= index) return; // overflow (samples were not read)
+        const short* k = this->kernel[(x >> (32 - BLIP_PHASE_BITS)) & (BLIP_PHASES - 1)];
+        int* out = &this->buffer[index];
+#ifdef __SSE2__
+        if (-32768 <= delta && delta <= 32767) {
+            // 8 taps per step: 16bit x 16bit multiply (low and high halves) widened to the 32bit products
+            const __m128i d = _mm_set1_epi16((short)delta);
+            for (int i = 0; i < BLIP_KERNEL_SIZE; i += 8) {
+                __m128i kv = _mm_loadu_si128((const __m128i*)&k[i]);
+                __m128i lo = _mm_mullo_epi16(kv, d);
+                __m128i hi = _mm_mulhi_epi16(kv, d);
+                __m128i* o = (__m128i*)&out[i];
+                _mm_storeu_si128(o, _mm_add_epi32(_mm_loadu_si128(o), _mm_unpacklo_epi16(lo, hi)));
+                _mm_storeu_si128(o + 1, _mm_add_epi32(_mm_loadu_si128(o + 1), _mm_unpackhi_epi16(lo, hi)));
+            }
+            return;
+        }
+#endif
+        for (int i = 0; i < BLIP_KERNEL_SIZE; i++) {
+            out[i] += k[i] * delta;
+        }
+    }
+
+    // change the clock rate keeping the buffered samples and the sub-sample position (for the rate control)
+    void changeClockRate(unsigned int clockRate)
+    {
+        if (!clockRate || clockRate == this->clockRate) return;
+        this->remainder = (unsigned int)((unsigned long long)this->remainder * clockRate / this->clockRate);
+        this->clockRate = clockRate;
+        this->factor = ((unsigned long long)this->sampleRate << 32) / this->clockRate;
+        this->offset = ((unsigned long long)this->remainder << 32) / this->clockRate;
+    }
+
+    // time: clocks of the current frame (the next frame starts from 0), returns the number of the new samples
+    inline int endFrame(unsigned int time)
+    {
+        unsigned long long x = (unsigned long long)time * this->sampleRate + this->remainder;
+        unsigned long long samples = this->available + x / this->clockRate;
+        int previous = this->available;
+        this->available = BLIP_BUFFER_SIZE < samples ? BLIP_BUFFER_SIZE : (int)samples;
+        this->remainder = (unsigned int)(x % this->clockRate);
+        this->offset = ((unsigned long long)this->remainder << 32) / this->clockRate;
+        return this->available - previous;
+    }
+
+    // read and remove the samples as int16 (returns the number of read samples)
+    int read(short* out, int count, bool stereo)
+    {
+        if (this->available < count) count = this->available;
+        int sum = this->integrator;
+        for (int i = 0; i < count; i++) {
+            sum += this->buffer[i];
+            int s = sum >> BLIP_UNIT_BITS;
+            if (32767 < s) {
+                s = 32767;
+            } else if (s < -32768) {
+                s = -32768;
+            }
+            *out++ = (short)s;
+            if (stereo) *out++ = (short)s;
+        }
+        this->integrator = sum;
+        this->remove(count);
+        return count;
+    }
+
+    // read and remove the samples as float32 (-1.0 ~ 1.0)
+    int read(float* out, int count, bool stereo)
+    {
+        const float scale = 1.0f / (1 << (BLIP_UNIT_BITS + 15));
+        if (this->available < count) count = this->available;
+        int sum = this->integrator;
+        for (int i = 0; i < count; i++) {
+            sum += this->buffer[i];
+            float s = sum * scale;
+            if (1.0f < s) {
+                s = 1.0f;
+            } else if (s < -1.0f) {
+                s = -1.0f;
+            }
+            *out++ = s;
+            if (stereo) *out++ = s;
+        }
+        this->integrator = sum;
+        this->remove(count);
+        return count;
+    }
+
+    // remove the samples without the output (keeps the integration)
+    void discard(int count)
+    {
+        if (this->available < count) count = this->available;
+        for (int i = 0; i < count; i++) this->integrator += this->buffer[i];
+        this->remove(count);
+    }
+
+  private:
+    inline void remove(int count)
+    {
+        int rest = this->available - count + BLIP_KERNEL_SIZE;
+        memmove(this->buffer, &this->buffer[count], rest * sizeof(int));
+        memset(&this->buffer[rest], 0, count * sizeof(int));
+        this->available -= count;
+    }
+
+    static const short (*getKernel())[BLIP_KERNEL_SIZE]
+    {
+        static short kernel[BLIP_PHASES][BLIP_KERNEL_SIZE];
+        static bool initialized = makeKernel(kernel);
+        (void)initialized;
+        return kernel;
+    }
+
+    static bool makeKernel(short kernel[BLIP_PHASES][BLIP_KERNEL_SIZE])
+    {
+        const double pi = 3.14159265358979323846;
+        const double cutoff = 0.9; // ratio of the nyquist frequency
+        const int half = BLIP_KERNEL_SIZE / 2;
+        for (int p = 0; p < BLIP_PHASES; p++) {
+            double h[BLIP_KERNEL_SIZE];
+            double total = 0;
+            for (int i = 0; i < BLIP_KERNEL_SIZE; i++) {
+                double x = i - (half - 1) - (p + 0.5) / BLIP_PHASES;
+                double w = 0.42 + 0.5 * cos(pi * x / half) + 0.08 * cos(2 * pi * x / half); // blackman
+                double s = x == 0 ? 1.0 : sin(pi * cutoff * x) / (pi * cutoff * x);
+                h[i] = s * w;
+                total += h[i];
+            }
+            // the sum of a phase must be exactly 1 (integration does not drift)
+            int sum = 0;
+            for (int i = 0; i < BLIP_KERNEL_SIZE; i++) {
+                kernel[p][i] = (short)floor(h[i] / total * (1 << BLIP_UNIT_BITS) + 0.5);
+                sum += kernel[p][i];
+            }
+            kernel[p][p < BLIP_PHASES / 2 ? half - 1 : half] += (1 << BLIP_UNIT_BITS) - sum;
+        }
+        return true;
+    }
+};
+
+#endif // INCLUDE_BLIPBUF_HPP
@@ -119,7 +119,8 @@ class MsxSlot
         return this->slots[ps].ptr[ss] ? this->slots[ps].ptr[ss][addr & 0x0FFF] : 0xFF;
     }
 
-    inline void write(unsigned short addr, unsigned char value)
+    // returns the written byte (NULL: not written)
+    inline unsigned char* write(unsigned short addr, unsigned char value)
     {
         int pn = (addr & 0b1100000000000000) >> 14;
         int sa = (addr & 0b0011000000000000) >> 12;
@@ -131,9 +132,11 @@ class MsxSlot
             }
         }
         ss += sa;
-        if (this->slots[ps].isReadOnly[ss]) return;
-        if (!this->slots[ps].ptr[ss]) return;
-        this->slots[ps].ptr[ss][addr & 0x0FFF] = value;
+        if (this->slots[ps].isReadOnly[ss]) return NULL;
+        if (!this->slots[ps].ptr[ss]) return NULL;
+        unsigned char* ptr = &this->slots[ps].ptr[ss][addr & 0x0FFF];
+        *ptr = value;
+        return ptr;
     }
 };
 
@@ -134,7 +134,8 @@ class MsxSlotASC8
         return this->slots[ps].ptr[ss] ? this->slots[ps].ptr[ss][addr & 0x0FFF] : 0xFF;
     }
 
-    inline void write(unsigned short addr, unsigned char value)
+    // returns the written byte (NULL: not written)
+    inline unsigned char* write(unsigned short addr, unsigned char value)
     {
         int pn = (addr & 0b1100000000000000) >> 14;
         int sa = (addr & 0b0011000000000000) >> 12;
@@ -147,9 +148,11 @@ class MsxSlotASC8
         }
         ss += sa;
         if (1 == ps && this->bankSwitchStart <= addr && addr < this->bankSwitchEnd) this->switchBank((addr - this->bankSwitchStart) / this->bankSwitchInterval, value);
-        if (this->slots[ps].isReadOnly[ss]) return;
-        if (!this->slots[ps].ptr[ss]) return;
-        this->slots[ps].ptr[ss][addr & 0x0FFF] = value;
+        if (this->slots[ps].isReadOnly[ss]) return NULL;
+        if (!this->slots[ps].ptr[ss]) return NULL;
+        unsigned char* ptr = &this->slots[ps].ptr[ss][addr & 0x0FFF];
+        *ptr = value;
+        return ptr;
     }
 
     inline void switchBank(int segNo, unsigned char value)
@@ -135,7 +135,8 @@ class MsxSlotASC8X
     }
 
 
-    inline void write(unsigned short addr, unsigned char value)
+    // returns the written byte (NULL: not written)
+    inline unsigned char* write(unsigned short addr, unsigned char value)
     {
         int pn = (addr & 0b1100000000000000) >> 14;
         int sa = (addr & 0b0011000000000000) >> 12;
@@ -149,11 +150,13 @@ class MsxSlotASC8X
         ss += sa;
         if (1 == ps && 0x6000 <= addr && addr < 0x8000) {
             this->switchBank((addr & 0x1800) >> 11, value & 0b00111111);
-            return;
+            return NULL;
         }
-        if (this->slots[ps].isReadOnly[ss]) return;
-        if (!this->slots[ps].ptr[ss]) return;
-        this->slots[ps].ptr[ss][addr & 0x0FFF] = value;
+        if (this->slots[ps].isReadOnly[ss]) return NULL;
+        if (!this->slots[ps].ptr[ss]) return NULL;
+        unsigned char* ptr = &this->slots[ps].ptr[ss][addr & 0x0FFF];
+        *ptr = value;
+        return ptr;
     }
 
     inline void switchBank(int segNo, unsigned char value)
@@ -0,0 +1,252 @@
+/**
+ * SUZUKI PLAN - TinyMSX - Rewind buffer
+ * -----------------------------------------------------------------------------
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Yoji Suzuki.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * -----------------------------------------------------------------------------
+ */
+#ifndef INCLUDE_REWINDBUFFER_HPP
+#define INCLUDE_REWINDBUFFER_HPP
+
+#include <stdlib.h>
+#include <string.h>
+
+#define REWIND_ENTRY_RATIO 128 // bytes of the budget per history entry (index capacity)
+
+/**
+ * History of the same sized states in a fixed memory budget.
+ * The newest state (snapshot) is kept as is, and each older state is stored as
+ * the difference to the next one (XOR) compressed with the zero runs and the literals:
+ *   0x00 ~ 0x7E: (n + 1) zero bytes
+ *   0x7F:        zero bytes (the length follows as u16 little endian)
+ *   0x80 ~ 0xFF: (n - 0x7F) literal bytes follow
+ * Rewinding applies the differences to the snapshot from the newest, and the oldest ones are dropped when the budget is full.
+ */
+class RewindBuffer
+{
+  private:
+    struct Entry {
+        unsigned int offset;
+        unsigned int size;
+    };
+    unsigned char* memory; // one block: snapshot, work, scratch, index and ring
+    unsigned char* snapshot;
+    unsigned char* work;
+    unsigned char* scratch;
+    Entry* entries;
+    unsigned char* ring;
+    size_t stateSize;
+    size_t scratchSize;
+    unsigned int ringSize;
+    unsigned int entryCapacity;
+    unsigned int first; // index of the oldest entry
+    unsigned int count;
+    unsigned int head; // ring position of the next entry
+    unsigned int frame; // frame number of the snapshot
+    bool hasSnapshot;
+
+  public:
+    RewindBuffer()
+    {
+        this->memory = NULL;
+        this->release();
+    }
+
+    ~RewindBuffer() { this->release(); }
+
+    /**
+     * Allocate the buffer (the index and the work buffers are included in the budget)
+     * - budget: bytes of the whole memory
+     * - stateSize: size of a state (all states must be the same size)
+     */
+    bool setup(size_t budget, size_t stateSize)
+    {
+        this->release();
+        size_t scratchSize = stateSize + stateSize / 128 + 4; // worst case: literals only
+        size_t fixed = stateSize * 2 + scratchSize;
+        if (!stateSize || budget < fixed * 2 || 0xFFFFFFFF < budget) return false;
+        unsigned int entryCapacity = (unsigned int)((budget - fixed) / REWIND_ENTRY_RATIO);
+        this->memory = (unsigned char*)malloc(budget);
+        if (!this->memory) return false;
+        this->snapshot = this->memory;
+        this->work = this->snapshot + stateSize;
+        this->entries = (Entry*)(((size_t)(this->work + stateSize) + 7) & ~(size_t)7);
+        this->scratch = (unsigned char*)(this->entries + entryCapacity);
+        this->ring = this->scratch + scratchSize;
+        this->stateSize = stateSize;
+        this->scratchSize = scratchSize;
+        this->ringSize = (unsigned int)(budget - (this->ring - this->memory));
+        this->entryCapacity = entryCapacity;
+        this->clear();
+        return true;
+    }
+
+    void release()
+    {
+        if (this->memory) free(this->memory);
+        this->memory = NULL;
+        this->snapshot = NULL;
+        this->work = NULL;
+        this->scratch = NULL;
+        this->entries = NULL;
+        this->ring = NULL;
+        this->stateSize = 0;
+        this->scratchSize = 0;
+        this->ringSize = 0;
+        this->entryCapacity = 0;
+        this->clear();
+    }
+
+    void clear()
+    {
+        this->first = 0;
+        this->count = 0;
+        this->head = 0;
+        this->frame = 0;
+        this->hasSnapshot = false;
+    }
+
+    inline bool isEnabled() { return NULL != this->memory; }
+    inline size_t getStateSize() { return this->stateSize; }
+    inline unsigned char* getWork() { return this->work; } // the caller serializes the next state here, and calls push
+    inline const unsigned char* getSnapshot() { return this->hasSnapshot ? this->snapshot : NULL; }
+    inline unsigned int getFrame() { return this->frame; }
+    inline unsigned int getOldestFrame() { return this->frame - this->count; }
+    inline unsigned int getCount() { return this->count; } // number of the frames that can be rewound
+
+    // add the state in the work buffer as the newest
+    void push()
+    {
+        if (!this->memory) return;
+        if (this->hasSnapshot) {
+            unsigned int size = (unsigned int)compress(this->work, this->snapshot, this->stateSize, this->scratch);
+            this->store(size);
+            this->frame++;
+        } else {
+            this->hasSnapshot = true;
+        }
+        unsigned char* previous = this->snapshot;
+        this->snapshot = this->work;
+        this->work = previous;
+    }
+
+    // restore the snapshot to the older frame (returns the number of the rewound frames)
+    unsigned int rewind(unsigned int frames)
+    {
+        if (this->count < frames) frames = this->count;
+        for (unsigned int i = 0; i < frames; i++) {
+            Entry* e = &this->entries[(this->first + this->count - 1) % this->entryCapacity];
+            decompress(&this->ring[e->offset], e->size, this->snapshot);
+            this->head = e->offset;
+            this->count--;
+        }
+        this->frame -= frames;
+        return frames;
+    }
+
+  private:
+    // store the compressed difference in the scratch to the ring (the oldest entries are dropped)
+    void store(unsigned int size)
+    {
+        if (this->ringSize < size) {
+            this->first = 0;
+            this->count = 0; // too large difference: the history is lost
+            return;
+        }
+        if (this->ringSize - this->head < size) this->head = 0;
+        while (0 < this->count) {
+            Entry* oldest = &this->entries[this->first];
+            bool overlap = oldest->offset < this->head + size && this->head < oldest->offset + oldest->size;
+            if (!overlap && this->count < this->entryCapacity) break;
+            this->first = (this->first + 1) % this->entryCapacity;
+            this->count--;
+        }
+        memcpy(&this->ring[this->head], this->scratch, size);
+        Entry* e = &this->entries[(this->first + this->count) % this->entryCapacity];
+        e->offset = this->head;
+        e->size = size;
+        this->count++;
+        this->head += size;
+    }
+
+    // compress (a XOR b), returns the compressed size
+    static size_t compress(const unsigned char* a, const unsigned char* b, size_t size, unsigned char* out)
+    {
+        unsigned char* start = out;
+        size_t i = 0;
+        while (i < size) {
+            // zero run (8 bytes per step while possible)
+            size_t zero = i;
+            while (zero + 8 <= size) {
+                unsigned long long x, y;
+                memcpy(&x, &a[zero], 8);
+                memcpy(&y, &b[zero], 8);
+                if (x != y) break;
+                zero += 8;
+            }
+            while (zero < size && a[zero] == b[zero]) zero++;
+            size_t run = zero - i;
+            while (run) {
+                if (run <= 127) {
+                    *out++ = (unsigned char)(run - 1);
+                    run = 0;
+                } else {
+                    size_t n = run < 0xFFFF ? run : 0xFFFF;
+                    *out++ = 0x7F;
+                    *out++ = n & 0xFF;
+                    *out++ = (n >> 8) & 0xFF;
+                    run -= n;
+                }
+            }
+            i = zero;
+            // literals (until 2 zero bytes in a row or the maximum length)
+            size_t literal = i;
+            while (literal < size && literal - i < 128) {
+                if (a[literal] == b[literal] && (literal + 1 == size || a[literal + 1] == b[literal + 1])) break;
+                literal++;
+            }
+            if (literal == i) continue;
+            *out++ = (unsigned char)(0x7F + literal - i);
+            for (; i < literal; i++) *out++ = a[i] ^ b[i];
+        }
+        return out - start;
+    }
+
+    // apply the compressed difference to the state
+    static void decompress(const unsigned char* in, size_t size, unsigned char* state)
+    {
+        const unsigned char* end = in + size;
+        while (in < end) {
+            unsigned char c = *in++;
+            if (c < 0x7F) {
+                state += c + 1;
+            } else if (0x7F == c) {
+                state += in[0] | in[1] << 8;
+                in += 2;
+            } else {
+                for (int n = c - 0x7F; n; n--) *state++ ^= *in++;
+            }
+        }
+    }
+};
+
+#endif // INCLUDE_REWINDBUFFER_HPP
@@ -0,0 +1,290 @@
+/**
+ * SUZUKI PLAN - TinyMSX - Rollback session
+ * -----------------------------------------------------------------------------
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Yoji Suzuki.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * -----------------------------------------------------------------------------
+ */
+#ifndef INCLUDE_ROLLBACK_HPP
+#define INCLUDE_ROLLBACK_HPP
+
+#include <stdlib.h>
+#include <string.h>
+#include "tinymsx.h"
+
+#define ROLLBACK_MAX_FRAMES 30    // maximum window (frames executed ahead of the confirmed remote input)
+#define ROLLBACK_INPUT_FRAMES 128 // frames of the input ring (the window + the input delay must be less than it)
+
+/**
+ * Two players session (a local player and a remote player) around TinyMSX::tick.
+ * - The local input is applied after the input delay, and the caller sends it to the peer with the frame number.
+ * - The missing remote input is predicted (the latest received one), and the frame advances without waiting.
+ * - When a received remote input differs from the prediction, the state of the frame is restored from the ring,
+ *   and the frames up to the current one are executed again (no sound, the status-only rendering).
+ * - The state hash at the start of a frame is final when all inputs before the frame are confirmed,
+ *   and the caller exchanges it with the peer to detect the desync.
+ * Both peers start from the same state with the same input delay. The transport is the caller's part.
+ */
+class RollbackSession
+{
+  private:
+    struct Frame {
+        unsigned int number;           // frame number of the slot
+        unsigned char input[2];        // pad1 and pad2 (the remote one is the prediction until it is confirmed)
+        unsigned char confirmed;       // bit per player
+        bool hasHash;                  // hash was saved (final after the frame is checked)
+        bool hasRemoteHash;
+        unsigned long long hash;       // state hash at the start of the frame
+        unsigned long long remoteHash; // received from the peer
+    };
+    TinyMSX* msx;
+    int local; // player index of the local input (0: pad1, 1: pad2)
+    int inputDelay;
+    int window;
+    unsigned char* states; // states at the start of the frames (window + 1)
+    size_t stateSize;
+    Frame frames[ROLLBACK_INPUT_FRAMES];
+    unsigned int current;      // next frame to execute
+    unsigned int confirmed;    // all inputs of the frames before it are confirmed
+    unsigned int localFrame;   // frame of the next local input
+    unsigned int checkedFrame; // the hashes of the frames before it are final (and compared)
+    unsigned int rollbackFrame; // the oldest mispredicted frame (valid while rollbackPending)
+    bool rollbackPending;
+    bool hasRemoteInput;
+    unsigned int latestRemoteFrame;
+    unsigned char latestRemoteInput;
+    bool desync;
+    unsigned int desyncFrame;
+    unsigned int rollbacks;
+    unsigned int resimulatedFrames;
+
+  public:
+    RollbackSession()
+    {
+        this->states = NULL;
+        this->release();
+    }
+
+    ~RollbackSession() { this->release(); }
+
+    /**
+     * Start the session from the current state of the instance
+     * - local: player index of the local input (0: pad1, 1: pad2)
+     * - inputDelay: frames between the local input and its frame (hides the latency without the rollback)
+     * - window: maximum frames to execute ahead of the confirmed remote input (1 ~ ROLLBACK_MAX_FRAMES)
+     */
+    bool setup(TinyMSX* msx, int local, int inputDelay, int window)
+    {
+        this->release();
+        if (!msx || local < 0 || 1 < local || inputDelay < 0 || window < 1 || ROLLBACK_MAX_FRAMES < window) return false;
+        if (ROLLBACK_INPUT_FRAMES <= window + inputDelay) return false;
+        this->stateSize = msx->getStateSize();
+        this->states = (unsigned char*)malloc(this->stateSize * (window + 1));
+        if (!this->states) return false;
+        this->msx = msx;
+        this->local = local;
+        this->inputDelay = inputDelay;
+        this->window = window;
+        this->localFrame = inputDelay;
+        this->updateConfirmed();
+        return true;
+    }
+
+    void release()
+    {
+        if (this->states) free(this->states);
+        this->states = NULL;
+        this->stateSize = 0;
+        this->msx = NULL;
+        this->local = 0;
+        this->inputDelay = 0;
+        this->window = 0;
+        memset(this->frames, 0, sizeof(this->frames));
+        for (int i = 0; i < ROLLBACK_INPUT_FRAMES; i++) this->frames[i].number = 0xFFFFFFFF;
+        this->current = 0;
+        this->confirmed = 0;
+        this->localFrame = 0;
+        this->checkedFrame = 0;
+        this->rollbackFrame = 0;
+        this->rollbackPending = false;
+        this->hasRemoteInput = false;
+        this->latestRemoteFrame = 0;
+        this->latestRemoteInput = 0;
+        this->desync = false;
+        this->desyncFrame = 0;
+        this->rollbacks = 0;
+        this->resimulatedFrames = 0;
+    }
+
+    inline unsigned int getCurrentFrame() { return this->current; }
+    inline unsigned int getConfirmedFrame() { return this->confirmed; }
+    inline unsigned int getRollbackCount() { return this->rollbacks; }
+    inline unsigned int getResimulatedFrames() { return this->resimulatedFrames; }
+    inline bool isDesynced() { return this->desync; }
+    inline unsigned int getDesyncFrame() { return this->desyncFrame; } // the first frame of the different hash
+
+    // add the local input of the next frame (frame: the number to send with the input)
+    bool addLocalInput(unsigned char pad, unsigned int* frame = NULL)
+    {
+        if (!this->msx || !this->isInRing(this->localFrame)) return false;
+        Frame* f = this->getSlot(this->localFrame);
+        f->input[this->local] = pad;
+        f->confirmed |= 1 << this->local;
+        if (frame) *frame = this->localFrame;
+        this->localFrame++;
+        this->updateConfirmed();
+        return true;
+    }
+
+    // add the received input of the remote player (the duplicated inputs are ignored)
+    bool addRemoteInput(unsigned int frame, unsigned char pad)
+    {
+        int remote = 1 - this->local;
+        if (!this->msx) return false;
+        if (frame < this->confirmed) return true;
+        if (!this->isInRing(frame)) return false;
+        Frame* f = this->getSlot(frame);
+        if (f->confirmed & (1 << remote)) return true;
+        if (frame < this->current && f->input[remote] != pad) {
+            if (!this->rollbackPending || frame < this->rollbackFrame) this->rollbackFrame = frame;
+            this->rollbackPending = true;
+        }
+        f->input[remote] = pad;
+        f->confirmed |= 1 << remote;
+        if (!this->hasRemoteInput || this->latestRemoteFrame <= frame) {
+            this->hasRemoteInput = true;
+            this->latestRemoteFrame = frame;
+            this->latestRemoteInput = pad;
+        }
+        this->updateConfirmed();
+        return true;
+    }
+
+    // add the state hash received from the peer (compared when the own hash of the frame is final)
+    bool addRemoteHash(unsigned int frame, unsigned long long hash)
+    {
+        if (!this->msx || !this->isInRing(frame)) return false;
+        Frame* f = this->getSlot(frame);
+        f->remoteHash = hash;
+        f->hasRemoteHash = true;
+        if (frame < this->checkedFrame) this->compareHash(f);
+        return true;
+    }
+
+    // get the final state hash at the start of the frame to send it to the peer (false: not final yet or too old)
+    bool getStateHash(unsigned int frame, unsigned long long* hash)
+    {
+        if (!this->msx || this->checkedFrame <= frame || !this->isInRing(frame)) return false;
+        Frame* f = &this->frames[frame % ROLLBACK_INPUT_FRAMES];
+        if (f->number != frame || !f->hasHash) return false;
+        *hash = f->hash;
+        return true;
+    }
+
+    /**
+     * Execute the current frame after the rollback (if a prediction was wrong)
+     * returns false if the local input of the frame is not added, or the remote input is too late (retry the next time)
+     */
+    bool advance(TinyMSXFrameInfo* info = NULL)
+    {
+        if (!this->msx || this->localFrame <= this->current) return false;
+        if (this->confirmed + this->window <= this->current) return false; // the window is full: wait for the remote input
+        if (this->rollbackPending) this->rollback();
+        Frame* f = this->getSlot(this->current);
+        this->saveState(f);
+        this->predict(f);
+        this->msx->tick(f->input[0], f->input[1], info);
+        this->current++;
+        // the states before the confirmed frame (and itself) are final
+        for (; this->checkedFrame <= this->confirmed && this->checkedFrame < this->current; this->checkedFrame++) {
+            Frame* checked = &this->frames[this->checkedFrame % ROLLBACK_INPUT_FRAMES];
+            if (checked->number == this->checkedFrame) this->compareHash(checked);
+        }
+        return true;
+    }
+
+  private:
+    // the slots can hold the frames from the oldest state in the window
+    inline bool isInRing(unsigned int frame)
+    {
+        unsigned int base = (unsigned int)this->window < this->current ? this->current - this->window : 0;
+        return base <= frame && frame - base < ROLLBACK_INPUT_FRAMES;
+    }
+
+    inline Frame* getSlot(unsigned int frame)
+    {
+        Frame* f = &this->frames[frame % ROLLBACK_INPUT_FRAMES];
+        if (f->number != frame) {
+            memset(f, 0, sizeof(Frame));
+            f->number = frame;
+            if (frame < (unsigned int)this->inputDelay) f->confirmed = 0b11; // no input before the delay
+        }
+        return f;
+    }
+
+    inline unsigned char* getState(unsigned int frame) { return &this->states[frame % (this->window + 1) * this->stateSize]; }
+
+    inline void saveState(Frame* f)
+    {
+        this->msx->saveSnapshot(this->getState(f->number), this->stateSize);
+        f->hash = this->msx->stateHash();
+        f->hasHash = true;
+    }
+
+    inline void predict(Frame* f)
+    {
+        int remote = 1 - this->local;
+        if (!(f->confirmed & (1 << remote))) f->input[remote] = this->hasRemoteInput ? this->latestRemoteInput : 0;
+    }
+
+    inline void updateConfirmed()
+    {
+        while (this->isInRing(this->confirmed) && 0b11 == this->getSlot(this->confirmed)->confirmed) this->confirmed++;
+    }
+
+    inline void compareHash(Frame* f)
+    {
+        if (this->desync || !f->hasHash || !f->hasRemoteHash || f->hash == f->remoteHash) return;
+        this->desync = true;
+        this->desyncFrame = f->number;
+    }
+
+    // restore the state of the mispredicted frame, and execute the frames again until the current one
+    void rollback()
+    {
+        unsigned int frame = this->rollbackFrame;
+        this->rollbackPending = false;
+        this->msx->restoreState(this->getState(frame), this->stateSize);
+        this->msx->setStatusOnlyRendering(true);
+        for (; frame < this->current; frame++) {
+            Frame* f = this->getSlot(frame);
+            if (frame != this->rollbackFrame) this->saveState(f);
+            this->predict(f);
+            this->msx->resimulate(f->input[0], f->input[1]);
+            this->resimulatedFrames++;
+        }
+        this->msx->setStatusOnlyRendering(false);
+        this->rollbacks++;
+    }
+};
+
+#endif // INCLUDE_ROLLBACK_HPP
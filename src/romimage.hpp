@@ -0,0 +1,137 @@
+/**
+ * SUZUKI PLAN - TinyMSX - Shared read-only ROM image
+ * -----------------------------------------------------------------------------
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Yoji Suzuki.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * -----------------------------------------------------------------------------
+ */
+#ifndef INCLUDE_ROMIMAGE_HPP
+#define INCLUDE_ROMIMAGE_HPP
+
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Read-only ROM data shared by the instances (reference counted).
+ * The data is a memory mapped file, a private copy or the caller memory (kept by the caller).
+ * Create it with the factory functions, and call release() when it is no longer used
+ * (each instance retains it while it is alive).
+ */
+class RomImage
+{
+  private:
+    enum Storage { STORAGE_CALLER, STORAGE_COPY, STORAGE_MAPPED };
+    std::atomic<int> refCount;
+    unsigned char* data;
+    size_t size;
+    Storage storage;
+
+    RomImage(unsigned char* data, size_t size, Storage storage)
+    {
+        this->refCount.store(1);
+        this->data = data;
+        this->size = size;
+        this->storage = storage;
+    }
+
+    ~RomImage()
+    {
+        switch (this->storage) {
+            case STORAGE_COPY: free(this->data); break;
+#ifndef _WIN32
+            case STORAGE_MAPPED: munmap(this->data, this->size); break;
+#endif
+            default: break;
+        }
+    }
+
+  public:
+    // refer the caller memory without copying (it must be kept until the image is destroyed)
+    static RomImage* fromMemory(const void* data, size_t size)
+    {
+        if (!data || !size) return NULL;
+        return new RomImage((unsigned char*)data, size, STORAGE_CALLER);
+    }
+
+    // make a private copy of the data
+    static RomImage* fromCopy(const void* data, size_t size)
+    {
+        if (!data || !size) return NULL;
+        unsigned char* copy = (unsigned char*)malloc(size);
+        if (!copy) return NULL;
+        memcpy(copy, data, size);
+        return new RomImage(copy, size, STORAGE_COPY);
+    }
+
+    // map the file (read only); a private copy is read on the platforms without mmap
+    static RomImage* fromFile(const char* path)
+    {
+#ifndef _WIN32
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return NULL;
+        struct stat st;
+        if (fstat(fd, &st) < 0 || st.st_size < 1) {
+            close(fd);
+            return NULL;
+        }
+        void* mapped = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (MAP_FAILED == mapped) return NULL;
+        return new RomImage((unsigned char*)mapped, (size_t)st.st_size, STORAGE_MAPPED);
+#else
+        FILE* fp = fopen(path, "rb");
+        if (!fp) return NULL;
+        fseek(fp, 0, SEEK_END);
+        long size = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        unsigned char* copy = 0 < size ? (unsigned char*)malloc(size) : NULL;
+        if (!copy || size != (long)fread(copy, 1, size, fp)) {
+            if (copy) free(copy);
+            fclose(fp);
+            return NULL;
+        }
+        fclose(fp);
+        return new RomImage(copy, (size_t)size, STORAGE_COPY);
+#endif
+    }
+
+    inline void retain() { this->refCount.fetch_add(1, std::memory_order_relaxed); }
+
+    inline void release()
+    {
+        if (1 == this->refCount.fetch_sub(1, std::memory_order_acq_rel)) delete this;
+    }
+
+    // NOTE: the data is read only (the slots register it as read only memory)
+    inline unsigned char* getData() { return this->data; }
+    inline size_t getSize() { return this->size; }
+};
+
+#endif // INCLUDE_ROMIMAGE_HPP
@@ -0,0 +1,338 @@
+/**
+ * SUZUKI PLAN - TinyMSX - Save state serializer
+ * -----------------------------------------------------------------------------
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Yoji Suzuki.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * -----------------------------------------------------------------------------
+ */
+#ifndef INCLUDE_SAVESTATE_HPP
+#define INCLUDE_SAVESTATE_HPP
+
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * State format (all integers are little endian):
+ *
+ * Header (16 bytes)
+ *   +0  "TMSX" (full state) or "TMSD" (delta state: applied on the state it was made from)
+ *   +4  version (u16)
+ *   +6  machine type (u16)
+ *   +8  total size including the header (u32)
+ *   +12 checksum (u32, Adler-32 of all bytes after the header)
+ *
+ * Chunk (12 bytes + payload), repeated until the total size
+ *   +0  ID (4 characters)
+ *   +4  flags (u32, 0: raw payload, SAVE_STATE_CHUNK_LZ: compressed payload)
+ *   +8  payload size (u32)
+ *   +12 payload (the fields are serialized one by one, no raw structs)
+ *
+ * Compressed payload: raw payload size (u32) + LZ stream of the raw payload
+ *   0x00 ~ 0x7F: (n + 1) literal bytes follow
+ *   0x80 ~ 0xFE: copy (n - 0x80 + 4) bytes from the distance (u16, 1 ~ 65535) before (overlap is a run)
+ *   0xFF:        copy (the length and the distance follow as u16)
+ *
+ * Memory chunks (RAM, VRAM, SRAM)
+ *   full:  size (u32) + bytes
+ *   delta: number of pages (u32) + [page index (u16) + 256 bytes] of the pages written since the reference state
+ *
+ * Base chunk (the first chunk of a delta state)
+ *   state hash (u64) of the reference state: the delta is rejected unless the current state has the same hash
+ */
+#define SAVE_STATE_MAGIC "TMSX"
+#define SAVE_STATE_DELTA_MAGIC "TMSD"
+#define SAVE_STATE_VERSION 2
+#define SAVE_STATE_HEADER_SIZE 16
+#define SAVE_STATE_CHUNK_HEADER_SIZE 12
+#define SAVE_STATE_PAGE_SIZE 256
+#define SAVE_STATE_CHUNK_LZ 0x01 // chunk flag: compressed payload
+#define SAVE_STATE_LZ_HASH_BITS 12
+#define SAVE_STATE_DIRTY_DELTA 0x01 // page flag: written since the last save or restore
+#define SAVE_STATE_DIRTY_HASH 0x02  // page flag: written since the last state hash
+
+/**
+ * Serialize the fields into a buffer, or deserialize from a buffer with the same code.
+ * The write mode without a buffer only counts the size.
+ * Overflow (too small buffer or too short data) is recorded and checked at the end.
+ */
+class StateSerializer
+{
+  private:
+    unsigned char* buffer;
+    size_t size;
+    size_t position;
+    bool reading;
+    bool error;
+
+  public:
+    StateSerializer(void* buffer, size_t size, bool reading)
+    {
+        this->buffer = (unsigned char*)buffer;
+        this->size = size;
+        this->position = 0;
+        this->reading = reading;
+        this->error = false;
+    }
+
+    inline bool isReading() { return this->reading; }
+    inline bool hasError() { return this->error; }
+    inline size_t getPosition() { return this->position; }
+    inline unsigned char* getBuffer() { return this->buffer; }
+    inline void fail() { this->error = true; } // invalid data
+
+    inline void bytes(void* data, size_t length)
+    {
+        if (this->reserve(length)) {
+            if (this->reading) {
+                memcpy(data, &this->buffer[this->position], length);
+            } else if (this->buffer) {
+                memcpy(&this->buffer[this->position], data, length);
+            }
+        }
+        this->position += length;
+    }
+
+    inline void u8(unsigned char* value) { this->bytes(value, 1); }
+
+    inline void u16(unsigned short* value)
+    {
+        unsigned int v = *value;
+        this->le(&v, 2);
+        *value = (unsigned short)v;
+    }
+
+    inline void u32(unsigned int* value) { this->le(value, 4); }
+    inline void s32(int* value) { this->le((unsigned int*)value, 4); }
+
+    // write the chunk header (the size is written by endChunk) and returns the position of the header
+    inline size_t beginChunk(const char* id)
+    {
+        size_t header = this->position;
+        unsigned int zero = 0;
+        this->bytes((void*)id, 4);
+        this->u32(&zero);
+        this->u32(&zero);
+        return header;
+    }
+
+    inline void endChunk(size_t header)
+    {
+        if (this->buffer && !this->error) {
+            setLE32(&this->buffer[header + 8], (unsigned int)(this->position - header - SAVE_STATE_CHUNK_HEADER_SIZE));
+        }
+    }
+
+    // compress the payload of the last chunk in place if it gets smaller (work: at least the payload size)
+    void compressChunk(size_t header, unsigned char* work, size_t workSize)
+    {
+        if (!this->buffer || this->reading || this->error) return;
+        unsigned char* payload = &this->buffer[header + SAVE_STATE_CHUNK_HEADER_SIZE];
+        size_t size = this->position - header - SAVE_STATE_CHUNK_HEADER_SIZE;
+        if (size <= 4 || workSize < size) return;
+        memcpy(work, payload, size);
+        size_t compressed = lzCompress(work, size, &payload[4], size - 4);
+        if (!compressed) {
+            memcpy(payload, work, size); // not compressible: keep the raw payload
+            return;
+        }
+        setLE32(payload, (unsigned int)size);
+        setLE32(&this->buffer[header + 4], SAVE_STATE_CHUNK_LZ);
+        setLE32(&this->buffer[header + 8], (unsigned int)(4 + compressed));
+        this->position = header + SAVE_STATE_CHUNK_HEADER_SIZE + 4 + compressed;
+    }
+
+    static inline unsigned int getLE32(const unsigned char* ptr)
+    {
+        return ptr[0] | ptr[1] << 8 | ptr[2] << 16 | (unsigned int)ptr[3] << 24;
+    }
+
+    static inline void setLE32(unsigned char* ptr, unsigned int value)
+    {
+        ptr[0] = value & 0xFF;
+        ptr[1] = (value >> 8) & 0xFF;
+        ptr[2] = (value >> 16) & 0xFF;
+        ptr[3] = (value >> 24) & 0xFF;
+    }
+
+    // 64bit hash (4 independent lanes of 8 bytes, the rounds and the finalizer of xxHash64)
+    static unsigned long long hash64(const void* data, size_t size, unsigned long long seed)
+    {
+        const unsigned long long p1 = 0x9E3779B185EBCA87ULL;
+        const unsigned long long p2 = 0xC2B2AE3D27D4EB4FULL;
+        const unsigned char* d = (const unsigned char*)data;
+        unsigned long long h[4] = {seed + p1 + p2, seed + p2, seed, seed - p1};
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32) {
+            for (int j = 0; j < 4; j++) {
+                unsigned long long v;
+                memcpy(&v, &d[i + j * 8], 8);
+                h[j] = rotl(h[j] + v * p2, 31) * p1;
+            }
+        }
+        unsigned long long result = rotl(h[0], 1) + rotl(h[1], 7) + rotl(h[2], 12) + rotl(h[3], 18) + size;
+        for (; i < size; i++) result = rotl(result ^ (d[i] * 0x27D4EB2F165667C5ULL), 11) * p1;
+        result ^= result >> 33;
+        result *= p2;
+        result ^= result >> 29;
+        result *= 0x165667B19E3779F9ULL;
+        result ^= result >> 32;
+        return result;
+    }
+
+    static unsigned int adler32(const unsigned char* data, size_t size)
+    {
+        unsigned int a = 1;
+        unsigned int b = 0;
+        while (0 < size) {
+            size_t n = size < 5552 ? size : 5552; // the largest block that does not overflow b
+            size -= n;
+            while (n--) {
+                a += *data++;
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+        }
+        return b << 16 | a;
+    }
+
+    // returns the compressed size (0: the output exceeds the capacity)
+    static size_t lzCompress(const unsigned char* src, size_t size, unsigned char* out, size_t capacity)
+    {
+        unsigned int table[1 << SAVE_STATE_LZ_HASH_BITS]; // last position + 1 of the 4 bytes sequences (0: none)
+        memset(table, 0, sizeof(table));
+        size_t o = 0;
+        size_t literal = 0; // start of the pending literals
+        size_t i = 0;
+        while (i + 4 <= size) {
+            unsigned int v;
+            memcpy(&v, &src[i], 4);
+            unsigned int h = (v * 2654435761U) >> (32 - SAVE_STATE_LZ_HASH_BITS);
+            size_t ref = table[h];
+            table[h] = (unsigned int)(i + 1);
+            if (!ref-- || 0xFFFF < i - ref || 0 != memcmp(&src[ref], &src[i], 4)) {
+                i++;
+                continue;
+            }
+            size_t length = 4;
+            while (i + length < size && length < 0xFFFF && src[ref + length] == src[i + length]) length++;
+            if (!lzLiterals(&src[literal], i - literal, out, capacity, &o) || capacity < o + 5) return 0;
+            size_t distance = i - ref;
+            if (length <= 130) {
+                out[o++] = (unsigned char)(0x80 + length - 4);
+            } else {
+                out[o++] = 0xFF;
+                out[o++] = length & 0xFF;
+                out[o++] = (length >> 8) & 0xFF;
+            }
+            out[o++] = distance & 0xFF;
+            out[o++] = (distance >> 8) & 0xFF;
+            i += length;
+            literal = i;
+        }
+        if (!lzLiterals(&src[literal], size - literal, out, capacity, &o)) return 0;
+        return o;
+    }
+
+    // returns false if the stream is broken or does not make exactly the size
+    static bool lzDecompress(const unsigned char* in, size_t inSize, unsigned char* dst, size_t size)
+    {
+        const unsigned char* end = in + inSize;
+        size_t o = 0;
+        while (in < end) {
+            unsigned char c = *in++;
+            if (c < 0x80) {
+                size_t n = c + 1;
+                if ((size_t)(end - in) < n || size - o < n) return false;
+                memcpy(&dst[o], in, n);
+                in += n;
+                o += n;
+                continue;
+            }
+            size_t length = c - 0x80 + 4;
+            if (0xFF == c) {
+                if (end - in < 2) return false;
+                length = in[0] | in[1] << 8;
+                in += 2;
+            }
+            if (end - in < 2) return false;
+            size_t distance = in[0] | in[1] << 8;
+            in += 2;
+            if (!distance || o < distance || size - o < length) return false;
+            if (1 == distance) {
+                memset(&dst[o], dst[o - 1], length);
+            } else if (length <= distance) {
+                memcpy(&dst[o], &dst[o - distance], length);
+            } else {
+                for (size_t i = 0; i < length; i++) dst[o + i] = dst[o + i - distance]; // overlap: repeat the pattern
+            }
+            o += length;
+        }
+        return o == size;
+    }
+
+  private:
+    static inline bool lzLiterals(const unsigned char* src, size_t n, unsigned char* out, size_t capacity, size_t* o)
+    {
+        while (n) {
+            size_t length = n < 128 ? n : 128;
+            if (capacity < *o + 1 + length) return false;
+            out[(*o)++] = (unsigned char)(length - 1);
+            memcpy(&out[*o], src, length);
+            *o += length;
+            src += length;
+            n -= length;
+        }
+        return true;
+    }
+
+    static inline unsigned long long rotl(unsigned long long x, int n) { return x << n | x >> (64 - n); }
+
+    inline bool reserve(size_t length)
+    {
+        if (this->error) return false;
+        if (this->reading || this->buffer) {
+            if (this->size < this->position + length) {
+                this->error = true;
+                return false;
+            }
+            return true;
+        }
+        return false; // size counting
+    }
+
+    inline void le(unsigned int* value, int length)
+    {
+        if (this->reserve(length)) {
+            if (this->reading) {
+                unsigned int v = 0;
+                for (int i = 0; i < length; i++) v |= (unsigned int)this->buffer[this->position + i] << (i * 8);
+                *value = v;
+            } else {
+                for (int i = 0; i < length; i++) this->buffer[this->position + i] = (*value >> (i * 8)) & 0xFF;
+            }
+        }
+        this->position += length;
+    }
+};
+
+#endif // INCLUDE_SAVESTATE_HPP
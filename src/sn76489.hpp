@@ -28,92 +28,155 @@
 #define INCLUDE_SN76489_HPP
 
 #include <string.h>
+#include "blipbuf.hpp"
+#include "vgmlogger.hpp"
 
 class SN76489
 {
   private:
-    unsigned int clock;
     unsigned char levels[16];
+    int output; // the last output level added to the blip buffer
+    VgmLogger* vgm;
 
   public:
     struct Context {
-        int bobo;
+        unsigned int time; // clocks from the start of the current frame
         int i;
         unsigned int r[8];
-        unsigned int c[4];
+        int c[4]; // clocks until the next tone toggle (0 ~ 2) or noise shift (3)
         unsigned int e[4];
         unsigned int np;
         unsigned int ns;
         unsigned int nx;
     } ctx;
 
-    void reset(int cpuRate, int sampleRate)
+    SN76489() { this->vgm = NULL; }
+
+    // log the register writes (NULL: disable)
+    inline void setVgmLogger(VgmLogger* vgm) { this->vgm = vgm; }
+
+    void reset()
     {
         memset(&ctx, 0, sizeof(ctx));
-        this->clock = cpuRate / ((double)sampleRate) * (1 << 16);
+        this->ctx.e[0] = 1;
+        this->ctx.e[1] = 1;
+        this->ctx.e[2] = 1;
+        this->ctx.np = 512;
+        this->ctx.c[3] = 512;
+        this->ctx.ns = 0x8000;
+        this->ctx.nx = 0x08000;
         unsigned char levels[16] = {255, 180, 127, 90, 63, 44, 31, 22, 15, 10, 7, 5, 3, 2, 1, 0};
         memcpy(this->levels, &levels, sizeof(levels));
+        this->output = 0;
     }
 
+    // NOTE: call run() with the current time before write() to apply the change at the exact timing
     inline void write(unsigned char value)
     {
+        if (this->vgm) this->vgm->writeSN76489(this->ctx.time, value);
+        unsigned int tp[3];
+        for (int i = 0; i < 3; i++) tp[i] = this->getTonePeriod(i);
+        unsigned int np = this->ctx.np;
         if (value & 0x80) {
             this->ctx.i = (value >> 4) & 7;
             this->ctx.r[this->ctx.i] = value & 0x0f;
+            if (6 == this->ctx.i) this->ctx.ns = 0x8000; // the noise register write resets the shift register
         } else {
             this->ctx.r[this->ctx.i] |= (value & 0x3f) << 4;
         }
+        for (int i = 0; i < 3; i++) {
+            unsigned int period = this->getTonePeriod(i);
+            if (period == tp[i]) continue;
+            if (period) {
+                this->ctx.c[i] = tp[i] ? this->changePeriod(this->ctx.c[i], tp[i], period) : period;
+            } else {
+                this->ctx.e[i] = 1;
+            }
+        }
+        // noise shift interval: 512, 1024, 2048 clocks or every 2 toggles of the tone 2
         switch (this->ctx.r[6] & 3) {
-            case 0: this->ctx.np = 1; break;
-            case 1: this->ctx.np = 2; break;
-            case 2: this->ctx.np = 4; break;
-            case 3: this->ctx.np = this->ctx.r[4]; break;
+            case 0: this->ctx.np = 512; break;
+            case 1: this->ctx.np = 1024; break;
+            case 2: this->ctx.np = 2048; break;
+            case 3: this->ctx.np = this->getTonePeriod(2) * 2; break;
+        }
+        if (this->ctx.np != np) {
+            this->ctx.c[3] = this->ctx.np ? (np ? this->changePeriod(this->ctx.c[3], np, this->ctx.np) : this->ctx.np) : 0;
         }
         this->ctx.nx = (this->ctx.r[6] & 0x04) ? 0x12000 : 0x08000;
     }
 
-    inline void tick(short* left, short* right)
+    /**
+     * Execute until the time (clocks from the start of the current frame) with the event stepping.
+     * The next tone toggle and noise shift times are computed with integers (no sampling rate dependency),
+     * and the output level changes are added to the blip buffer.
+     */
+    inline void run(BlipBuffer* blip, unsigned int time)
     {
-        for (int i = 0; i < 3; i++) {
-            int regidx = i << 1;
-            if (this->ctx.r[regidx]) {
-                unsigned int cc = this->clock + this->ctx.c[i];
-                while ((cc & 0x80000000) == 0) {
-                    cc -= (this->ctx.r[regidx] << (16 + 4));
-                    this->ctx.e[i] ^= 1;
+        this->updateOutput(blip);
+        while (this->ctx.time < time) {
+            int step = (int)(time - this->ctx.time);
+            for (int i = 0; i < 3; i++) {
+                if (this->ctx.r[i << 1] && this->ctx.c[i] < step) step = this->ctx.c[i];
+            }
+            if (this->ctx.np && this->ctx.c[3] < step) step = this->ctx.c[3];
+            this->ctx.time += step;
+            for (int i = 0; i < 3; i++) {
+                if (this->ctx.r[i << 1]) {
+                    this->ctx.c[i] -= step;
+                    if (0 == this->ctx.c[i]) {
+                        this->ctx.c[i] = this->ctx.r[i << 1] << 4;
+                        this->ctx.e[i] ^= 1;
+                    }
                 }
-                this->ctx.c[i] = cc;
-            } else {
-                this->ctx.e[i] = 1;
             }
-        }
-        if (this->ctx.np) {
-            unsigned int cc = this->clock + this->ctx.c[3];
-            while ((cc & 0x80000000) == 0) {
-                cc -= (this->ctx.np << (16 + 4));
-                this->ctx.ns >>= 1;
-                if (this->ctx.ns & 1) {
-                    this->ctx.ns = this->ctx.ns ^ this->ctx.nx;
-                    this->ctx.e[3] = 1;
-                } else {
-                    this->ctx.e[3] = 0;
+            if (this->ctx.np) {
+                this->ctx.c[3] -= step;
+                if (0 == this->ctx.c[3]) {
+                    this->ctx.c[3] = this->ctx.np;
+                    this->ctx.ns >>= 1;
+                    if (this->ctx.ns & 1) {
+                        this->ctx.ns = this->ctx.ns ^ this->ctx.nx;
+                        this->ctx.e[3] = 1;
+                    } else {
+                        this->ctx.e[3] = 0;
+                    }
                 }
             }
-            this->ctx.c[3] = cc;
+            this->updateOutput(blip);
         }
+    }
+
+    // execute until the end of the frame, and the next frame starts from time 0
+    inline void endFrame(BlipBuffer* blip, unsigned int time)
+    {
+        this->run(blip, time);
+        this->ctx.time -= time;
+    }
+
+  private:
+    // tone toggle interval (clocks)
+    inline unsigned int getTonePeriod(int i) { return this->ctx.r[i << 1] << 4; }
+
+    // keep the elapsed clocks of the current period when the period was changed
+    inline int changePeriod(int counter, unsigned int oldPeriod, unsigned int newPeriod)
+    {
+        int elapsed = (int)oldPeriod - counter;
+        return elapsed < (int)newPeriod ? (int)newPeriod - elapsed : 1;
+    }
+
+    inline void updateOutput(BlipBuffer* blip)
+    {
         int w = 0;
-        if (this->ctx.e[0]) w += this->levels[this->ctx.r[1]];
-        if (this->ctx.e[1]) w += this->levels[this->ctx.r[3]];
-        if (this->ctx.e[2]) w += this->levels[this->ctx.r[5]];
-        if (this->ctx.e[3]) w += this->levels[this->ctx.r[7]];
+        if (this->ctx.e[0]) w += this->levels[this->ctx.r[1] & 0x0F];
+        if (this->ctx.e[1]) w += this->levels[this->ctx.r[3] & 0x0F];
+        if (this->ctx.e[2]) w += this->levels[this->ctx.r[5] & 0x0F];
+        if (this->ctx.e[3]) w += this->levels[this->ctx.r[7] & 0x0F];
         w <<= 4;
-        if (32767 < w) {
-            w = 32767;
-        } else if (w < -32768) {
-            w = -32768;
+        if (w != this->output) {
+            blip->addDelta(this->ctx.time, w - this->output);
+            this->output = w;
         }
-        *left = (short)w;
-        *right = (short)w;
     }
 };
 
@@ -30,34 +30,57 @@
 #define MASTER_CLOCK 10738635 // Unused in this emulator
 #define CPU_CLOCK 3579545     // Master Clock div 3
 #define VDP_CLOCK 5370863     // 342 * 262 * 59.94 (Actually: Master Clock div 2)
-#define PSG_CLOCK 44100       // Output sampling rate
-
-#define STATE_CHUNK_CPU "CP"
-#define STATE_CHUNK_RAM "RA"
-#define STATE_CHUNK_VDP "VD"
-#define STATE_CHUNK_SN7 "S7"
-#define STATE_CHUNK_AY3 "A3"
-#define STATE_CHUNK_SLT "SL"
-#define STATE_CHUNK_GM2 "G2"
-#define STATE_CHUNK_A08 "A8"
-#define STATE_CHUNK_A8W "AW"
-#define STATE_CHUNK_A8X "AX"
-#define STATE_CHUNK_IO "IO"
+#define PSG_CLOCK 44100       // Output sampling rate (default)
+#define SOUND_BUFFER_SIZE 131072 // bytes buffered for getSoundBuffer
+#define SOUND_CHUNK_SIZE 4096    // bytes per sound callback or ring write
+
+#define STATE_CHUNK_CPU "CPU "
+#define STATE_CHUNK_RAM "RAM "
+#define STATE_CHUNK_RAM_DELTA "RAM+"
+#define STATE_CHUNK_VDP "VDP "
+#define STATE_CHUNK_VRM "VRAM"
+#define STATE_CHUNK_VRM_DELTA "VRM+"
+#define STATE_CHUNK_SN7 "SN7 "
+#define STATE_CHUNK_AY3 "AY3 "
+#define STATE_CHUNK_SLT "SLOT"
+#define STATE_CHUNK_A08 "ASC8"
+#define STATE_CHUNK_A8X "A8X "
+#define STATE_CHUNK_SRM "SRAM"
+#define STATE_CHUNK_SRM_DELTA "SRM+"
+#define STATE_CHUNK_IO "IO  "
+#define STATE_CHUNK_BASE "BASE" // delta only: the state hash of the base
+#define STATE_CHUNK_MAX 16 // maximum number of the chunks in a state
+#define STATE_HASH_BUFFER_SIZE 2048 // serialized chunks except the memory (CPU, VDP, PSG, slots and I/O)
+#define STATE_MEMORY_CHUNK_MAX (4 + 0x10000 / SAVE_STATE_PAGE_SIZE * (2 + SAVE_STATE_PAGE_SIZE)) // largest payload (delta of all RAM pages)
+
+// hot state of an instance (the display, the sound buffer and the state buffer are allocated on demand)
+static_assert(sizeof(TinyMSX) + sizeof(TMS9918A) + sizeof(Z80) < 128 * 1024, "TinyMSX instance is too large");
+
+static unsigned char emptyBios[0x8000]; // mapped until a BIOS is loaded
 
 static void detectBlank(void* arg) { ((TinyMSX*)arg)->cpu->generateIRQ(0x07); }
 static void detectBreak(void* arg) { ((TinyMSX*)arg)->cpu->requestBreak(); }
 
 TinyMSX::TinyMSX(int type, const void* rom, size_t romSize, size_t ramSize, int colorMode)
+{
+    RomImage* image = RomImage::fromCopy(rom, romSize);
+    this->setup(type, image, ramSize, colorMode);
+    if (image) image->release(); // retained by setup
+}
+
+TinyMSX::TinyMSX(int type, RomImage* rom, size_t ramSize, int colorMode)
+{
+    this->setup(type, rom, ramSize, colorMode);
+}
+
+void TinyMSX::setup(int type, RomImage* rom, size_t ramSize, int colorMode)
 {
     this->type = type;
-    if (NULL != rom && 0 < romSize) {
-        this->rom = (unsigned char*)malloc(romSize);
-        if (this->rom) {
-            memcpy(this->rom, rom, romSize);
-            this->romSize = romSize;
-        } else {
-            this->romSize = 0;
-        }
+    this->romImage = rom;
+    if (rom) {
+        rom->retain();
+        this->rom = rom->getData();
+        this->romSize = rom->getSize();
     } else {
         this->rom = NULL;
         this->romSize = 0;
@@ -66,7 +89,22 @@ TinyMSX::TinyMSX(int type, const void* rom, size_t romSize, size_t ramSize, int
     this->cpu = new Z80([](void* arg, unsigned short addr) { return ((TinyMSX*)arg)->readMemory(addr); }, [](void* arg, unsigned short addr, unsigned char value) { return ((TinyMSX*)arg)->writeMemory(addr, value); }, [](void* arg, unsigned char port) { return ((TinyMSX*)arg)->inPort(port); }, [](void* arg, unsigned char port, unsigned char value) { return ((TinyMSX*)arg)->outPort(port, value); }, this);
     this->cpu->setConsumeClockCallback([](void* arg, int clocks) { ((TinyMSX*)arg)->consumeClock(clocks); });
     this->tms9918 = new TMS9918A(colorMode, this, detectBlank, detectBreak);
-    memset(&this->bios, 0, sizeof(this->bios));
+    this->ready = this->tms9918->hasOutput();
+    this->blip.setRates(CPU_CLOCK, PSG_CLOCK);
+    this->soundChannels = 2;
+    this->soundFormat = TINYMSX_SOUND_FORMAT_S16;
+    this->soundBuffer = NULL;
+    this->soundCallback = NULL;
+    this->soundCallbackArg = NULL;
+    this->soundOverflowFrames = 0;
+    this->soundSampleRate = PSG_CLOCK;
+    this->soundRateAdjust = 0;
+    this->bios = NULL;
+    this->stateCompression = false;
+    this->runAheadFrames = 0;
+    this->runAheadState = NULL;
+    this->runAheadStateSize = 0;
+    this->runAheadBlip = NULL;
     reset();
 }
 
@@ -76,10 +114,67 @@ TinyMSX::~TinyMSX()
     this->tms9918 = NULL;
     if (this->cpu) delete this->cpu;
     this->cpu = NULL;
-    if (this->rom) free(this->rom);
+    if (this->romImage) this->romImage->release();
+    this->romImage = NULL;
+    if (this->bios) this->bios->release();
+    this->bios = NULL;
+    if (this->soundBuffer) free(this->soundBuffer);
+    this->soundBuffer = NULL;
+    if (this->runAheadState) free(this->runAheadState);
+    this->runAheadState = NULL;
+    if (this->runAheadBlip) delete this->runAheadBlip;
+    this->runAheadBlip = NULL;
     this->rom = NULL;
 }
 
+TinyMSX* TinyMSX::clone()
+{
+    TinyMSX* result = new TinyMSX(this->type, this->romImage, this->ramSize, this->tms9918->getColorMode());
+    result->copyFrom(this);
+    return result;
+}
+
+bool TinyMSX::copyFrom(TinyMSX* source)
+{
+    if (source == this) return true;
+    if (source->type != this->type || source->romImage != this->romImage || source->ramSize != this->ramSize) return false;
+    if (source->bios && source->bios != this->bios) this->setBios(source->bios);
+    memcpy(&this->cpu->reg, &source->cpu->reg, sizeof(this->cpu->reg));
+    memcpy(&this->tms9918->ctx, &source->tms9918->ctx, sizeof(this->tms9918->ctx));
+    memcpy(this->tms9918->vramDirty, source->tms9918->vramDirty, sizeof(this->tms9918->vramDirty));
+    this->tms9918->invalidateLines();
+    memcpy(this->io, source->io, sizeof(this->io));
+    memcpy(this->ram, source->ram, this->ramSize);
+    memcpy(this->ramDirty, source->ramDirty, sizeof(this->ramDirty));
+    memcpy(this->sramDirty, source->sramDirty, sizeof(this->sramDirty));
+    memcpy(this->ramHash, source->ramHash, sizeof(this->ramHash));
+    memcpy(this->vramHash, source->vramHash, sizeof(this->vramHash));
+    memcpy(this->sramHash, source->sramHash, sizeof(this->sramHash));
+    this->baseHash = source->baseHash;
+    this->sn76489 = source->sn76489;
+    this->sn76489.setVgmLogger(&this->vgm);
+    this->ay8910 = source->ay8910;
+    this->ay8910.setVgmLogger(&this->vgm);
+    if (this->isMSX1()) {
+        memcpy(&this->slot.ctx, &source->slot.ctx, sizeof(this->slot.ctx));
+    } else if (this->isMSX1_ASC8()) {
+        memcpy(&this->slotASC8.ctx, &source->slotASC8.ctx, sizeof(this->slotASC8.ctx));
+        this->slotASC8.reloadBank();
+    } else if (this->isMSX1_ASC8X()) {
+        memcpy(&this->slotASC8X.ctx, &source->slotASC8X.ctx, sizeof(this->slotASC8X.ctx));
+        this->slotASC8X.reloadBank();
+    }
+    memcpy(this->pad, source->pad, sizeof(this->pad));
+    memcpy(this->specialKeyX, source->specialKeyX, sizeof(this->specialKeyX));
+    memcpy(this->specialKeyY, source->specialKeyY, sizeof(this->specialKeyY));
+    this->blip = source->blip;
+    this->soundSampleRate = source->soundSampleRate;
+    this->soundRateAdjust = source->soundRateAdjust;
+    this->soundClock = source->soundClock;
+    memcpy(&this->frameInfo, &source->frameInfo, sizeof(this->frameInfo));
+    return true;
+}
+
 void TinyMSX::reset()
 {
     memset(&this->cpu->reg, 0, sizeof(this->cpu->reg));
@@ -91,16 +186,16 @@ void TinyMSX::reset()
     this->tms9918->reset();
     memset(this->io, 0xFF, sizeof(this->io));
     memset(this->ram, 0, sizeof(this->ram));
-    memset(&this->ay8910, 0, sizeof(this->ay8910));
+    memset(this->ramDirty, 0xFF, sizeof(this->ramDirty));
+    memset(this->sramDirty, 0xFF, sizeof(this->sramDirty));
     if (this->isSG1000()) {
-        this->sn76489.reset(CPU_CLOCK, PSG_CLOCK);
+        this->sn76489.reset();
         this->ramSize = 0x800;
     } else if (this->isMSX1Family()) {
         this->ay8910.reset(27);
         this->slot_reset();
         this->slot_init(this->rom);
-        this->slot_add(0, 0, &this->bios.main[0x0000], true);
-        this->slot_add(0, 1, &this->bios.main[0x4000], true);
+        this->slot_addBios();
         if (this->rom) {
             this->slot_add(1, 0, this->rom, true);
             if (0x4000 < this->romSize) this->slot_add(1, 1, &this->rom[0x4000], true);
@@ -137,11 +232,17 @@ void TinyMSX::reset()
         this->slot_setupSlot(2, 0b00000010);
         this->slot_setupSlot(3, 0b00000011);
     }
-    memset(this->soundBuffer, 0, sizeof(this->soundBuffer));
     this->soundBufferCursor = 0;
+    this->blip.clear();
+    this->soundClock = 0;
+    memset(&this->frameInfo, 0, sizeof(this->frameInfo));
+    this->frameInfo.clockRate = CPU_CLOCK;
+    this->sn76489.setVgmLogger(&this->vgm);
+    this->ay8910.setVgmLogger(&this->vgm);
+    this->baseHash = this->stateHash(); // the reset state is the base of the next delta
 }
 
-void TinyMSX::tick(unsigned char pad1, unsigned char pad2)
+void TinyMSX::setPads(unsigned char pad1, unsigned char pad2)
 {
     this->pad[0] = 0;
     this->pad[1] = 0;
@@ -176,18 +277,237 @@ void TinyMSX::tick(unsigned char pad1, unsigned char pad2)
         this->pad[1] |= pad2 & TINYMSX_JOY_T2 ? 0 : 0b00001000;
         this->pad[1] |= 0b11110000;
     }
+}
+
+void TinyMSX::tick(unsigned char pad1, unsigned char pad2, TinyMSXFrameInfo* info)
+{
+    this->setPads(pad1, pad2);
     if (this->cpu) {
         this->cpu->execute(0x7FFFFFFF);
     }
+    this->flushSound();
+    if (this->rewindBuffer.isEnabled()) {
+        this->writeState(this->rewindBuffer.getWork(), this->rewindBuffer.getStateSize(), false, false);
+        this->rewindBuffer.push();
+    }
+    if (this->runAheadFrames) this->runAhead();
+    if (this->frames.isEnabled()) {
+        this->frames.publish(this->tms9918->getFrameCount());
+        this->tms9918->swapOutputBuffer(this->frames.getBack(), this->frames.getBackTag());
+    }
+    if (info) memcpy(info, &this->frameInfo, sizeof(this->frameInfo));
+}
+
+bool TinyMSX::setRunAhead(int frames)
+{
+    if (frames < 0 || TINYMSX_RUN_AHEAD_MAX < frames) return false;
+    if (frames && !this->runAheadState) {
+        this->runAheadStateSize = this->writeState(NULL, 0, false, false);
+        this->runAheadState = (unsigned char*)malloc(this->runAheadStateSize);
+        if (!this->runAheadState) return false;
+        this->runAheadBlip = new BlipBuffer();
+    }
+    this->runAheadFrames = frames;
+    return true;
+}
+
+// execute a frame without the sound output, the VGM log, the frame info and the rewind capture
+void TinyMSX::runSilentFrame()
+{
+    this->sn76489.setVgmLogger(NULL);
+    this->ay8910.setVgmLogger(NULL);
+    this->cpu->execute(0x7FFFFFFF);
+    if (this->isSG1000()) {
+        this->sn76489.endFrame(&this->blip, this->soundClock);
+    } else {
+        this->ay8910.endFrame(&this->blip, this->soundClock);
+    }
+    this->blip.endFrame(this->soundClock);
+    this->blip.discard(this->blip.getAvailable()); // keeps the integration (the sound continues without a gap)
+    this->soundClock = 0;
+    this->sn76489.setVgmLogger(&this->vgm);
+    this->ay8910.setVgmLogger(&this->vgm);
+}
+
+void TinyMSX::resimulate(unsigned char pad1, unsigned char pad2)
+{
+    this->setPads(pad1, pad2);
+    this->runSilentFrame();
+}
+
+// run the next frames with the same input, and go back to the current frame keeping the display of the last one
+// (the sound, the VGM log and the dirty pages of the speculative frames are discarded)
+void TinyMSX::runAhead()
+{
+    if (!this->writeState(this->runAheadState, this->runAheadStateSize, false, false)) return;
+    unsigned char ramDirty[sizeof(this->ramDirty)];
+    unsigned char sramDirty[sizeof(this->sramDirty)];
+    unsigned char vramDirty[sizeof(this->tms9918->vramDirty)];
+    memcpy(ramDirty, this->ramDirty, sizeof(ramDirty));
+    memcpy(sramDirty, this->sramDirty, sizeof(sramDirty));
+    memcpy(vramDirty, this->tms9918->vramDirty, sizeof(vramDirty));
+    unsigned long long baseHash = this->baseHash; // the speculative restore is not the base of the next delta
+    *this->runAheadBlip = this->blip;
+    SN76489 sn76489 = this->sn76489; // including the last output level of the blip buffer and the VGM logger
+    AY8910 ay8910 = this->ay8910;
+    for (int i = 0; i < this->runAheadFrames; i++) this->runSilentFrame();
+    this->restoreState(this->runAheadState, this->runAheadStateSize);
+    this->blip = *this->runAheadBlip;
+    this->sn76489 = sn76489;
+    this->ay8910 = ay8910;
+    memcpy(this->ramDirty, ramDirty, sizeof(ramDirty));
+    memcpy(this->sramDirty, sramDirty, sizeof(sramDirty));
+    memcpy(this->tms9918->vramDirty, vramDirty, sizeof(vramDirty));
+    this->baseHash = baseHash;
+}
+
+bool TinyMSX::setTripleBuffer(void* buffer1, void* buffer2, void* buffer3, size_t pitch, int colorMode, bool border)
+{
+    if (!buffer1 || !buffer2 || !buffer3) {
+        return this->setDisplayBuffer(NULL, 0, colorMode); // disable
+    }
+    if (!this->setDisplayBuffer(buffer1, pitch, colorMode, border)) {
+        return false;
+    }
+    this->frames.setup(buffer1, buffer2, buffer3);
+    return true;
+}
+
+bool TinyMSX::convertDisplayBuffer(void* buffer, int colorMode)
+{
+    // the internal display only (released while setDisplayBuffer or setTripleBuffer is used)
+    if (!this->tms9918->display) return false;
+    int srcColorMode = this->tms9918->getOutputColorMode();
+    if (TINYMSX_COLOR_MODE_INDEXED8 != srcColorMode && TINYMSX_COLOR_MODE_INDEXED4 != srcColorMode) {
+        return false;
+    }
+    TMS9918A::convertIndexedPixels(srcColorMode, this->tms9918->display, colorMode, buffer, TMS9918A_SCREEN_WIDTH * TMS9918A_SCREEN_HEIGHT);
+    return true;
+}
+
+bool TinyMSX::startVgmLog(const char* path)
+{
+    if (this->isSG1000()) {
+        if (!this->vgm.open(path, CPU_CLOCK, CPU_CLOCK, 0)) return false;
+        // write the current registers (the latched register is written at last)
+        for (int n = 1; n <= 8; n++) {
+            int i = (this->sn76489.ctx.i + n) & 7;
+            unsigned int r = this->sn76489.ctx.r[i];
+            this->vgm.writeSN76489(this->soundClock, 0x80 | i << 4 | (r & 0x0F));
+            if (0 == (i & 1) && i < 6) this->vgm.writeSN76489(this->soundClock, (r >> 4) & 0x3F);
+        }
+    } else if (this->isMSX1Family()) {
+        if (!this->vgm.open(path, CPU_CLOCK, 0, CPU_CLOCK / 2)) return false;
+        for (int i = 0; i < 14; i++) {
+            this->vgm.writeAY8910(this->soundClock, i, this->ay8910.ctx.reg[i]);
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+inline void TinyMSX::slot_addBios()
+{
+    unsigned char* main = this->bios ? this->bios->getData() : emptyBios;
+    this->slot_add(0, 0, &main[0x0000], true);
+    this->slot_add(0, 1, &main[0x4000], true);
+}
+
+inline void TinyMSX::flushSound()
+{
+    if (this->isSG1000()) {
+        this->sn76489.endFrame(&this->blip, this->soundClock);
+    } else if (this->isMSX1Family()) {
+        this->ay8910.endFrame(&this->blip, this->soundClock);
+    }
+    int samples = this->blip.endFrame(this->soundClock);
+    this->frameInfo.frameNumber++;
+    this->frameInfo.sampleStart += this->frameInfo.samples;
+    this->frameInfo.samples = samples;
+    this->frameInfo.cycleStart = this->frameInfo.cycleEnd;
+    this->frameInfo.cycleEnd += this->soundClock;
+    this->vgm.endFrame(this->soundClock);
+    this->soundClock = 0;
+    size_t sampleSize = (TINYMSX_SOUND_FORMAT_F32 == this->soundFormat ? 4 : 2) * this->soundChannels;
+    bool push = this->soundCallback || this->soundRing.isEnabled();
+    float chunk[SOUND_CHUNK_SIZE / sizeof(float)]; // push mode does not need the sound buffer
+    if (!push && !this->soundBuffer) {
+        this->soundBuffer = (unsigned char*)malloc(SOUND_BUFFER_SIZE);
+        this->soundBufferCursor = 0;
+    }
+    while (0 < this->blip.getAvailable()) {
+        int count = this->blip.getAvailable();
+        size_t capacity = push ? SOUND_CHUNK_SIZE : (this->soundBuffer ? SOUND_BUFFER_SIZE - this->soundBufferCursor : 0);
+        int space = (int)(capacity / sampleSize);
+        if (space < 1) {
+            this->soundOverflowFrames += count; // getSoundBuffer was not called for a long time
+            this->blip.discard(count);
+            break;
+        }
+        if (space < count) count = space;
+        void* ptr = push ? (void*)chunk : &this->soundBuffer[this->soundBufferCursor];
+        if (TINYMSX_SOUND_FORMAT_F32 == this->soundFormat) {
+            count = this->blip.read((float*)ptr, count, 2 == this->soundChannels);
+        } else {
+            count = this->blip.read((short*)ptr, count, 2 == this->soundChannels);
+        }
+        if (this->soundCallback) {
+            this->soundCallback(this->soundCallbackArg, ptr, count * sampleSize);
+        } else if (this->soundRing.isEnabled()) {
+            this->soundRing.write(ptr, count);
+        } else {
+            this->soundBufferCursor += count * sampleSize;
+        }
+    }
 }
 
 void* TinyMSX::getSoundBuffer(size_t* size)
 {
-    *size = this->soundBufferCursor * 2;
+    *size = this->soundBufferCursor;
     this->soundBufferCursor = 0;
     return this->soundBuffer;
 }
 
+bool TinyMSX::setSoundFormat(int sampleRate, int channels, int format)
+{
+    if (sampleRate < 1000 || 192000 < sampleRate) return false;
+    if (1 != channels && 2 != channels) return false;
+    if (TINYMSX_SOUND_FORMAT_S16 != format && TINYMSX_SOUND_FORMAT_F32 != format) return false;
+    this->blip.setRates(CPU_CLOCK, sampleRate);
+    this->soundSampleRate = sampleRate;
+    this->setSoundRateAdjust(this->soundRateAdjust);
+    this->soundChannels = channels;
+    this->soundFormat = format;
+    this->soundBufferCursor = 0;
+    if (this->soundRing.isEnabled()) {
+        return this->setSoundRing(this->soundRing.getLatency());
+    }
+    return true;
+}
+
+/**
+ * Produce ppm more (plus) or less (minus) samples per emulated second, to follow the host audio clock.
+ * The band-limited synthesis runs at the adjusted rate directly (no resampling).
+ */
+bool TinyMSX::setSoundRateAdjust(int ppm)
+{
+    if (ppm < -5000 || 5000 < ppm) return false; // within +-0.5%
+    this->soundRateAdjust = ppm;
+    this->blip.changeClockRate((unsigned int)((unsigned long long)CPU_CLOCK * 1000000 / (1000000 + ppm)));
+    return true;
+}
+
+bool TinyMSX::setSoundRing(unsigned int latency)
+{
+    if (0 == latency) {
+        this->soundRing.release();
+        return true;
+    }
+    size_t frameSize = (TINYMSX_SOUND_FORMAT_F32 == this->soundFormat ? 4 : 2) * this->soundChannels;
+    return this->soundRing.setup(latency, frameSize);
+}
+
 inline unsigned char TinyMSX::readMemory(unsigned short addr)
 {
     if (this->isSG1000()) {
@@ -216,12 +536,19 @@ inline void TinyMSX::writeMemory(unsigned short addr, unsigned char value)
             return;
         } else {
             this->ram[addr & 0x07FF] = value;
+            this->ramDirty[(addr & 0x07FF) / SAVE_STATE_PAGE_SIZE] = 0xFF;
         }
     } else {
         if (0xFFFF == addr) {
             this->slot_changeSecondarySlots(value);
         } else {
-            this->slot_write(addr, value);
+            unsigned char* ptr = this->slot_write(addr, value);
+            if (!ptr) return;
+            if (this->ram <= ptr && ptr < &this->ram[sizeof(this->ram)]) {
+                this->ramDirty[(ptr - this->ram) / SAVE_STATE_PAGE_SIZE] = 0xFF;
+            } else if (this->isMSX1_ASC8X() && this->slotASC8X.ctx.sram <= ptr && ptr < &this->slotASC8X.ctx.sram[sizeof(this->slotASC8X.ctx.sram)]) {
+                this->sramDirty[(ptr - this->slotASC8X.ctx.sram) / SAVE_STATE_PAGE_SIZE] = 0xFF;
+            }
         }
     }
 }
@@ -340,8 +667,11 @@ inline void TinyMSX::outPort(unsigned char port, unsigned char value)
     this->io[port] = value;
     if (this->isSG1000()) {
         switch (port) {
-            case 0x7E: this->sn76489.write(value); break;
-            case 0x7F: this->sn76489.write(value); break;
+            case 0x7E:
+            case 0x7F:
+                this->sn76489.run(&this->blip, this->soundClock);
+                this->sn76489.write(value);
+                break;
             case 0xBE: this->tms9918->writeData(value); break;
             case 0xBF: this->tms9918->writeAddress(value); break;
             case 0xDE: break; // keyboard port (ignore)
@@ -353,7 +683,10 @@ inline void TinyMSX::outPort(unsigned char port, unsigned char value)
             case 0x98: this->tms9918->writeData(value); break;
             case 0x99: this->tms9918->writeAddress(value); break;
             case 0xA0: this->ay8910.latch(value); break;
-            case 0xA1: this->ay8910.write(value); break;
+            case 0xA1:
+                this->ay8910.run(&this->blip, this->soundClock);
+                this->ay8910.write(value);
+                break;
             case 0xA8: this->slot_changePrimarySlots(value); break;
             case 0xAA: break; // to access the register that control the keyboard CAP LED, two signals to data recorder and a matrix row (use the port C of PPI)
             case 0xAB: break; // to access the ports control register. (Write only)
@@ -369,21 +702,7 @@ inline void TinyMSX::outPort(unsigned char port, unsigned char value)
 inline void TinyMSX::consumeClock(int cpuClocks)
 {
     // execute PSG
-    if (this->isSG1000()) {
-        this->sn76489.ctx.bobo += cpuClocks * PSG_CLOCK;
-        while (0 < this->sn76489.ctx.bobo) {
-            this->sn76489.ctx.bobo -= CPU_CLOCK;
-            this->sn76489.tick(&this->soundBuffer[this->soundBufferCursor], &this->soundBuffer[this->soundBufferCursor + 1]);
-            this->soundBufferCursor += 2;
-        }
-    } else if (this->isMSX1Family()) {
-        this->ay8910.ctx.bobo += cpuClocks * PSG_CLOCK;
-        while (0 < this->ay8910.ctx.bobo) {
-            this->ay8910.ctx.bobo -= CPU_CLOCK;
-            this->ay8910.tick(&this->soundBuffer[this->soundBufferCursor], &this->soundBuffer[this->soundBufferCursor + 1], 81);
-            this->soundBufferCursor += 2;
-        }
-    }
+    this->soundClock += cpuClocks; // PSG is executed on the register write and the frame end
     // execute VDP
     this->tms9918->ctx.bobo += cpuClocks * VDP_CLOCK;
     while (0 < this->tms9918->ctx.bobo) {
@@ -392,124 +711,460 @@ inline void TinyMSX::consumeClock(int cpuClocks)
     }
 }
 
-bool TinyMSX::loadSpecificSizeFile(const char* path, void* buffer, size_t size)
+bool TinyMSX::loadBiosFromFile(const char* path)
 {
-    FILE* fp = fopen(path, "rb");
-    if (!fp) {
-        return false;
+    RomImage* bios = RomImage::fromFile(path);
+    bool result = this->setBios(bios);
+    if (bios) bios->release();
+    return result;
+}
+
+bool TinyMSX::loadBiosFromMemory(void* bios, size_t size)
+{
+    if (size != 0x8000) return false;
+    RomImage* image = RomImage::fromCopy(bios, size);
+    bool result = this->setBios(image);
+    if (image) image->release();
+    return result;
+}
+
+bool TinyMSX::setBios(RomImage* bios)
+{
+    if (!bios || bios->getSize() != 0x8000) return false;
+    bios->retain();
+    if (this->bios) this->bios->release();
+    this->bios = bios;
+    if (this->isMSX1Family()) this->slot_addBios();
+    return true;
+}
+
+int TinyMSX::getStateChunks(const char** ids, bool delta)
+{
+    int n = 0;
+    if (delta) ids[n++] = STATE_CHUNK_BASE; // first, to be checked before the others
+    ids[n++] = STATE_CHUNK_CPU;
+    ids[n++] = delta ? STATE_CHUNK_RAM_DELTA : STATE_CHUNK_RAM;
+    ids[n++] = STATE_CHUNK_VDP;
+    ids[n++] = delta ? STATE_CHUNK_VRM_DELTA : STATE_CHUNK_VRM;
+    if (this->isSG1000()) {
+        ids[n++] = STATE_CHUNK_SN7;
+    } else {
+        ids[n++] = STATE_CHUNK_AY3;
+        if (this->isMSX1()) ids[n++] = STATE_CHUNK_SLT;
+        if (this->isMSX1_ASC8()) ids[n++] = STATE_CHUNK_A08;
+        if (this->isMSX1_ASC8X()) {
+            ids[n++] = STATE_CHUNK_A8X;
+            ids[n++] = delta ? STATE_CHUNK_SRM_DELTA : STATE_CHUNK_SRM;
+        }
     }
-    if (-1 == fseek(fp, 0, SEEK_END)) {
-        fclose(fp);
-        return false;
+    ids[n++] = STATE_CHUNK_IO;
+    return n;
+}
+
+static bool isMemoryChunk(const char* id)
+{
+    const char* memories[6] = {STATE_CHUNK_RAM, STATE_CHUNK_RAM_DELTA, STATE_CHUNK_VRM, STATE_CHUNK_VRM_DELTA, STATE_CHUNK_SRM, STATE_CHUNK_SRM_DELTA};
+    for (int i = 0; i < 6; i++) {
+        if (0 == memcmp(id, memories[i], 4)) return true;
     }
-    long fileSize = ftell(fp);
-    if (fileSize != size) {
-        fclose(fp);
-        return false;
+    return false;
+}
+
+// memory chunk: the whole memory, or the pages written since the reference state (delta)
+static void serializeMemory(StateSerializer* s, unsigned char* data, size_t size, unsigned char* dirty, bool delta)
+{
+    unsigned int pages = (unsigned int)(size / SAVE_STATE_PAGE_SIZE);
+    if (!delta) {
+        unsigned int length = (unsigned int)size;
+        s->u32(&length);
+        if (size < length) {
+            s->fail();
+            return;
+        }
+        s->bytes(data, length);
+        if (s->isReading()) {
+            memset(&data[length], 0, size - length);
+            for (unsigned int i = 0; i < pages; i++) dirty[i] |= SAVE_STATE_DIRTY_HASH;
+        }
+        return;
     }
-    if (-1 == fseek(fp, 0, SEEK_SET)) {
-        fclose(fp);
-        return false;
+    unsigned int count = 0;
+    if (!s->isReading()) {
+        for (unsigned int i = 0; i < pages; i++) count += dirty[i] & SAVE_STATE_DIRTY_DELTA ? 1 : 0;
     }
-    if (size != fread(buffer, 1, size, fp)) {
-        fclose(fp);
-        return false;
+    s->u32(&count);
+    unsigned short page = 0;
+    for (unsigned int i = 0; i < count && !s->hasError(); i++, page++) {
+        if (!s->isReading()) {
+            while (!(dirty[page] & SAVE_STATE_DIRTY_DELTA)) page++;
+        }
+        s->u16(&page);
+        if (pages <= page) {
+            s->fail();
+            return;
+        }
+        s->bytes(&data[page * SAVE_STATE_PAGE_SIZE], SAVE_STATE_PAGE_SIZE);
+        if (s->isReading()) dirty[page] |= SAVE_STATE_DIRTY_HASH;
     }
-    fclose(fp);
-    return true;
 }
 
-bool TinyMSX::loadBiosFromFile(const char* path) { return this->loadSpecificSizeFile(path, this->bios.main, 0x8000); }
+// check the layout of a memory chunk payload written by serializeMemory
+static bool checkMemory(const unsigned char* payload, size_t payloadSize, size_t size, bool delta)
+{
+    if (payloadSize < 4) return false;
+    size_t n = StateSerializer::getLE32(payload);
+    if (!delta) return n <= size && payloadSize == 4 + n;
+    if (size / SAVE_STATE_PAGE_SIZE < n || payloadSize != 4 + n * (2 + SAVE_STATE_PAGE_SIZE)) return false;
+    for (size_t i = 0; i < n; i++) {
+        const unsigned char* p = &payload[4 + i * (2 + SAVE_STATE_PAGE_SIZE)];
+        if (size / SAVE_STATE_PAGE_SIZE <= (size_t)(p[0] | p[1] << 8)) return false;
+    }
+    return true;
+}
 
-bool TinyMSX::loadBiosFromMemory(void* bios, size_t size)
+// serialize (or deserialize) the payload of a chunk field by field (returns false if the chunk is unknown)
+bool TinyMSX::serializeChunk(StateSerializer* s, const char* id)
 {
-    if (size != 0x8000) return false;
-    memcpy(this->bios.main, bios, size);
+    if (0 == memcmp(id, STATE_CHUNK_CPU, 4)) {
+        Z80::RegisterPair* pairs[2] = {&this->cpu->reg.pair, &this->cpu->reg.back};
+        for (int i = 0; i < 2; i++) {
+            s->u8(&pairs[i]->A);
+            s->u8(&pairs[i]->F);
+            s->u8(&pairs[i]->B);
+            s->u8(&pairs[i]->C);
+            s->u8(&pairs[i]->D);
+            s->u8(&pairs[i]->E);
+            s->u8(&pairs[i]->H);
+            s->u8(&pairs[i]->L);
+        }
+        s->u16(&this->cpu->reg.PC);
+        s->u16(&this->cpu->reg.SP);
+        s->u16(&this->cpu->reg.IX);
+        s->u16(&this->cpu->reg.IY);
+        s->u16(&this->cpu->reg.interruptVector);
+        s->u16(&this->cpu->reg.interruptAddrN);
+        s->u16(&this->cpu->reg.WZ);
+        s->u8(&this->cpu->reg.R);
+        s->u8(&this->cpu->reg.I);
+        s->u8(&this->cpu->reg.IFF);
+        s->u8(&this->cpu->reg.interrupt);
+        s->u8(&this->cpu->reg.consumeClockCounter);
+        s->u8(&this->cpu->reg.execEI);
+    } else if (0 == memcmp(id, STATE_CHUNK_RAM, 4) || 0 == memcmp(id, STATE_CHUNK_RAM_DELTA, 4)) {
+        serializeMemory(s, this->ram, this->ramSize, this->ramDirty, 0 != memcmp(id, STATE_CHUNK_RAM, 4));
+    } else if (0 == memcmp(id, STATE_CHUNK_VDP, 4)) {
+        TMS9918A::Context* c = &this->tms9918->ctx;
+        s->s32(&c->bobo);
+        s->s32(&c->countH);
+        s->s32(&c->countV);
+        s->bytes(c->reg, sizeof(c->reg));
+        s->bytes(c->tmpAddr, sizeof(c->tmpAddr));
+        s->u16(&c->addr);
+        s->u16(&c->writeAddr);
+        s->u8(&c->stat);
+        s->u8(&c->latch);
+        s->u8(&c->readBuffer);
+        s->u8(&c->writeWait);
+        if (s->isReading()) this->tms9918->invalidateLines();
+    } else if (0 == memcmp(id, STATE_CHUNK_SN7, 4)) {
+        SN76489::Context* c = &this->sn76489.ctx;
+        s->u32(&c->time);
+        s->s32(&c->i);
+        for (int i = 0; i < 8; i++) s->u32(&c->r[i]);
+        for (int i = 0; i < 4; i++) s->s32(&c->c[i]);
+        for (int i = 0; i < 4; i++) s->u32(&c->e[i]);
+        s->u32(&c->np);
+        s->u32(&c->ns);
+        s->u32(&c->nx);
+    } else if (0 == memcmp(id, STATE_CHUNK_AY3, 4)) {
+        AY8910::Context* c = &this->ay8910.ctx;
+        s->u32(&c->time);
+        s->u8(&c->latch);
+        s->bytes(c->reg, sizeof(c->reg));
+        for (int i = 0; i < 3; i++) s->u32(&c->tPeriod[i]);
+        for (int i = 0; i < 3; i++) s->s32(&c->tCounter[i]);
+        for (int i = 0; i < 3; i++) s->u32(&c->tUp[i]);
+        s->u32(&c->nPeriod);
+        s->s32(&c->nCounter);
+        s->u32(&c->nUp);
+        s->u32(&c->ePeriod);
+        s->s32(&c->eCounter);
+        s->u32(&c->eState);
+        s->s32(&c->eFace);
+        s->u32(&c->eHolding);
+        s->u32(&c->random);
+    } else if (0 == memcmp(id, STATE_CHUNK_SLT, 4)) {
+        s->bytes(this->slot.ctx.page, sizeof(this->slot.ctx.page));
+        s->bytes(this->slot.ctx.slot, sizeof(this->slot.ctx.slot));
+    } else if (0 == memcmp(id, STATE_CHUNK_VRM, 4) || 0 == memcmp(id, STATE_CHUNK_VRM_DELTA, 4)) {
+        TMS9918A::Context* c = &this->tms9918->ctx;
+        serializeMemory(s, c->ram, sizeof(c->ram), this->tms9918->vramDirty, 0 != memcmp(id, STATE_CHUNK_VRM, 4));
+        if (s->isReading()) this->tms9918->invalidateLines();
+    } else if (0 == memcmp(id, STATE_CHUNK_A08, 4)) {
+        s->bytes(this->slotASC8.ctx.page, sizeof(this->slotASC8.ctx.page));
+        s->bytes(this->slotASC8.ctx.slot, sizeof(this->slotASC8.ctx.slot));
+        s->bytes(this->slotASC8.ctx.seg, sizeof(this->slotASC8.ctx.seg));
+        if (s->isReading()) this->slotASC8.reloadBank();
+    } else if (0 == memcmp(id, STATE_CHUNK_A8X, 4)) {
+        s->bytes(this->slotASC8X.ctx.page, sizeof(this->slotASC8X.ctx.page));
+        s->bytes(this->slotASC8X.ctx.slot, sizeof(this->slotASC8X.ctx.slot));
+        s->bytes(this->slotASC8X.ctx.seg, sizeof(this->slotASC8X.ctx.seg));
+        if (s->isReading()) this->slotASC8X.reloadBank();
+    } else if (0 == memcmp(id, STATE_CHUNK_SRM, 4) || 0 == memcmp(id, STATE_CHUNK_SRM_DELTA, 4)) {
+        serializeMemory(s, this->slotASC8X.ctx.sram, sizeof(this->slotASC8X.ctx.sram), this->sramDirty, 0 != memcmp(id, STATE_CHUNK_SRM, 4));
+    } else if (0 == memcmp(id, STATE_CHUNK_IO, 4)) {
+        s->bytes(this->io, sizeof(this->io));
+    } else if (0 == memcmp(id, STATE_CHUNK_BASE, 4)) {
+        unsigned int hash[2] = {(unsigned int)this->baseHash, (unsigned int)(this->baseHash >> 32)};
+        s->u32(&hash[0]); // read by checkChunk (the reader does not change the state)
+        s->u32(&hash[1]);
+    } else {
+        return false;
+    }
     return true;
 }
 
-static int writeSaveState(unsigned char* buf, int ptr, const char* c, size_t s, void* data)
+// check the payload of a chunk without changing the state (unknown chunks are ignored)
+bool TinyMSX::checkChunk(const char* id, const unsigned char* payload, size_t size)
 {
-    buf[ptr++] = c[0];
-    buf[ptr++] = c[1];
-    unsigned short size = s & 0xFFFF;
-    memcpy(&buf[ptr], &size, 2);
-    ptr += 2;
-    memcpy(&buf[ptr], data, size);
-    return (int)(s + 4);
+    if (0 == memcmp(id, STATE_CHUNK_RAM, 4) || 0 == memcmp(id, STATE_CHUNK_RAM_DELTA, 4)) {
+        return checkMemory(payload, size, this->ramSize, 0 != memcmp(id, STATE_CHUNK_RAM, 4));
+    } else if (0 == memcmp(id, STATE_CHUNK_VRM, 4) || 0 == memcmp(id, STATE_CHUNK_VRM_DELTA, 4)) {
+        return checkMemory(payload, size, sizeof(this->tms9918->ctx.ram), 0 != memcmp(id, STATE_CHUNK_VRM, 4));
+    } else if (0 == memcmp(id, STATE_CHUNK_SRM, 4) || 0 == memcmp(id, STATE_CHUNK_SRM_DELTA, 4)) {
+        return checkMemory(payload, size, sizeof(this->slotASC8X.ctx.sram), 0 != memcmp(id, STATE_CHUNK_SRM, 4));
+    } else if (0 == memcmp(id, STATE_CHUNK_BASE, 4)) {
+        // the delta is applied only on the state it was made from
+        if (8 != size) return false;
+        unsigned long long hash = StateSerializer::getLE32(payload) | (unsigned long long)StateSerializer::getLE32(&payload[4]) << 32;
+        return hash == this->stateHash();
+    }
+    StateSerializer s(NULL, 0, false); // the fixed layout chunks: count the serialized size
+    if (!this->serializeChunk(&s, id)) return true;
+    return s.getPosition() == size;
 }
 
-size_t TinyMSX::calcAvairableRamSize()
+void TinyMSX::clearDirtyPages()
 {
-    size_t result = 0;
-    for (int i = 0; i < this->ramSize; i++) {
-        if (this->ram[i]) {
-            result = i + 1;
+    for (size_t i = 0; i < sizeof(this->ramDirty); i++) this->ramDirty[i] &= ~SAVE_STATE_DIRTY_DELTA;
+    for (size_t i = 0; i < sizeof(this->sramDirty); i++) this->sramDirty[i] &= ~SAVE_STATE_DIRTY_DELTA;
+    for (size_t i = 0; i < sizeof(this->tms9918->vramDirty); i++) this->tms9918->vramDirty[i] &= ~SAVE_STATE_DIRTY_DELTA;
+}
+
+// update the hashes of the pages written since the last call
+static void hashPages(const unsigned char* data, size_t size, unsigned char* dirty, unsigned long long* hash, bool all)
+{
+    for (size_t i = 0; i < size / SAVE_STATE_PAGE_SIZE; i++) {
+        if (all || (dirty[i] & SAVE_STATE_DIRTY_HASH)) {
+            hash[i] = StateSerializer::hash64(&data[i * SAVE_STATE_PAGE_SIZE], SAVE_STATE_PAGE_SIZE, i);
+            dirty[i] &= ~SAVE_STATE_DIRTY_HASH;
         }
     }
+}
+
+unsigned long long TinyMSX::stateHash(bool incremental)
+{
+    hashPages(this->ram, this->ramSize, this->ramDirty, this->ramHash, !incremental);
+    hashPages(this->tms9918->ctx.ram, sizeof(this->tms9918->ctx.ram), this->tms9918->vramDirty, this->vramHash, !incremental);
+    // the other chunks are small: hash the serialized fields
+    unsigned char buffer[STATE_HASH_BUFFER_SIZE];
+    StateSerializer s(buffer, sizeof(buffer), false);
+    const char* ids[STATE_CHUNK_MAX];
+    int n = this->getStateChunks(ids, false);
+    for (int i = 0; i < n; i++) {
+        if (isMemoryChunk(ids[i])) continue;
+        this->serializeChunk(&s, ids[i]);
+    }
+    unsigned long long result = StateSerializer::hash64(buffer, s.getPosition(), this->type);
+    result = StateSerializer::hash64(this->ramHash, this->ramSize / SAVE_STATE_PAGE_SIZE * sizeof(unsigned long long), result);
+    result = StateSerializer::hash64(this->vramHash, sizeof(this->vramHash), result);
+    if (this->isMSX1_ASC8X()) {
+        hashPages(this->slotASC8X.ctx.sram, sizeof(this->slotASC8X.ctx.sram), this->sramDirty, this->sramHash, !incremental);
+        result = StateSerializer::hash64(this->sramHash, sizeof(this->sramHash), result);
+    }
     return result;
 }
 
-const void* TinyMSX::saveState(size_t* size)
+// reference: false = internal snapshot (no checksum, the dirty pages are kept for the delta states of the caller)
+size_t TinyMSX::writeState(void* buffer, size_t size, bool delta, bool reference)
 {
-    int ptr = 0;
-    ptr += writeSaveState(this->tmpBuffer, ptr, STATE_CHUNK_CPU, sizeof(this->cpu->reg), &this->cpu->reg);
-    ptr += writeSaveState(this->tmpBuffer, ptr, STATE_CHUNK_RAM, this->calcAvairableRamSize(), this->ram);
-    ptr += writeSaveState(this->tmpBuffer, ptr, STATE_CHUNK_VDP, sizeof(this->tms9918->ctx), &this->tms9918->ctx);
-    if (this->isSG1000()) {
-        ptr += writeSaveState(this->tmpBuffer, ptr, STATE_CHUNK_SN7, sizeof(this->sn76489.ctx), &this->sn76489.ctx);
-    } else if (this->isMSX1()) {
-        ptr += writeSaveState(this->tmpBuffer, ptr, STATE_CHUNK_AY3, sizeof(this->ay8910.ctx), &this->ay8910.ctx);
-        ptr += writeSaveState(this->tmpBuffer, ptr, STATE_CHUNK_SLT, sizeof(this->slot.ctx), &this->slot.ctx);
-    } else if (this->isMSX1_ASC8()) {
-        ptr += writeSaveState(this->tmpBuffer, ptr, STATE_CHUNK_AY3, sizeof(this->ay8910.ctx), &this->ay8910.ctx);
-        ptr += writeSaveState(this->tmpBuffer, ptr, STATE_CHUNK_A08, sizeof(this->slotASC8.ctx), &this->slotASC8.ctx);
-    } else if (this->isMSX1_ASC8X()) {
-        ptr += writeSaveState(this->tmpBuffer, ptr, STATE_CHUNK_AY3, sizeof(this->ay8910.ctx), &this->ay8910.ctx);
-        ptr += writeSaveState(this->tmpBuffer, ptr, STATE_CHUNK_A8X, sizeof(this->slotASC8X.ctx), &this->slotASC8X.ctx);
+    StateSerializer s(buffer, size, false);
+    unsigned short version = SAVE_STATE_VERSION;
+    unsigned short type = (unsigned short)this->type;
+    unsigned int zero = 0;
+    s.bytes((void*)(delta ? SAVE_STATE_DELTA_MAGIC : SAVE_STATE_MAGIC), 4);
+    s.u16(&version);
+    s.u16(&type);
+    s.u32(&zero); // total size
+    s.u32(&zero); // checksum
+    // the memory chunks of the saved states are compressed (optional), and the size query returns the raw size as the maximum
+    unsigned char* work = NULL;
+    if (buffer && reference && this->stateCompression) {
+        work = (unsigned char*)malloc(STATE_MEMORY_CHUNK_MAX);
+        if (!work) return 0;
     }
-    ptr += writeSaveState(this->tmpBuffer, ptr, STATE_CHUNK_IO, sizeof(this->io), &this->io);
-    *size = ptr;
-    return this->tmpBuffer;
+    const char* ids[STATE_CHUNK_MAX];
+    int n = this->getStateChunks(ids, delta);
+    for (int i = 0; i < n; i++) {
+        size_t header = s.beginChunk(ids[i]);
+        this->serializeChunk(&s, ids[i]);
+        s.endChunk(header);
+        if (work && isMemoryChunk(ids[i])) s.compressChunk(header, work, STATE_MEMORY_CHUNK_MAX);
+    }
+    if (work) free(work);
+    if (!buffer) return s.getPosition(); // size query
+    if (s.hasError()) return 0;
+    unsigned char* ptr = (unsigned char*)buffer;
+    StateSerializer::setLE32(&ptr[8], (unsigned int)s.getPosition());
+    if (!reference) return s.getPosition();
+    StateSerializer::setLE32(&ptr[12], StateSerializer::adler32(&ptr[SAVE_STATE_HEADER_SIZE], s.getPosition() - SAVE_STATE_HEADER_SIZE));
+    this->clearDirtyPages(); // the saved state is the reference of the next delta
+    this->baseHash = this->stateHash();
+    return s.getPosition();
 }
 
-void TinyMSX::loadState(const void* data, size_t size)
+// returns the total size if the header and the checksum are valid (0: invalid)
+size_t TinyMSX::verifyState(const void* data, size_t size, const char* magic)
 {
-    reset();
-    char* d = (char*)data;
-    int s = (int)size;
-    unsigned short ds;
-    while (4 < s) {
-        memcpy(&ds, &d[2], 2);
-        const char* ch = &d[0];
-        d += 4;
-        s -= 4;
-        if (s < ds) break; // invalid size
-        if (0 == strncmp(ch, STATE_CHUNK_CPU, 2)) {
-            memcpy(&((Z80*)this->cpu)->reg, d, ds);
-        } else if (0 == strncmp(ch, STATE_CHUNK_RAM, 2)) {
-            memcpy(this->ram, d, ds);
-        } else if (0 == strncmp(ch, STATE_CHUNK_VDP, 2)) {
-            this->tms9918->reset();
-            memcpy(&this->tms9918->ctx, d, ds);
-        } else if (0 == strncmp(ch, STATE_CHUNK_SN7, 2)) {
-            memcpy(&this->sn76489.ctx, d, ds);
-        } else if (0 == strncmp(ch, STATE_CHUNK_AY3, 2)) {
-            memcpy(&this->ay8910.ctx, d, ds);
-        } else if (0 == strncmp(ch, STATE_CHUNK_SLT, 2)) {
-            memcpy(&this->slot.ctx, d, ds);
-        } else if (this->isMSX1_ASC8() && 0 == strncmp(ch, STATE_CHUNK_A08, 2)) {
-            memcpy(&this->slotASC8.ctx, d, ds);
-            this->slotASC8.reloadBank();
-        } else if (this->isMSX1_ASC8X() && 0 == strncmp(ch, STATE_CHUNK_A8X, 2)) {
-            memcpy(&this->slotASC8X.ctx, d, ds);
-            this->slotASC8X.reloadBank();
-        } else if (0 == strncmp(ch, STATE_CHUNK_IO, 2)) {
-            memcpy(this->io, d, ds);
-        } else {
-            // ignore unknown chunk
+    const unsigned char* d = (const unsigned char*)data;
+    if (!d || size < SAVE_STATE_HEADER_SIZE || 0 != memcmp(d, magic, 4)) return 0;
+    if (SAVE_STATE_VERSION != (d[4] | d[5] << 8) || this->type != (d[6] | d[7] << 8)) return 0;
+    size_t total = StateSerializer::getLE32(&d[8]);
+    if (total < SAVE_STATE_HEADER_SIZE || size < total) return 0;
+    if (StateSerializer::getLE32(&d[12]) != StateSerializer::adler32(&d[SAVE_STATE_HEADER_SIZE], total - SAVE_STATE_HEADER_SIZE)) return 0;
+    return total;
+}
+
+bool TinyMSX::loadState(const void* data, size_t size)
+{
+    size_t total = this->verifyState(data, size, SAVE_STATE_MAGIC);
+    if (!total) total = this->verifyState(data, size, SAVE_STATE_DELTA_MAGIC);
+    return total && this->restoreState(data, total);
+}
+
+bool TinyMSX::loadStateChain(const void* base, size_t baseSize, const void* const* deltas, const size_t* deltaSizes, int count)
+{
+    if (!this->verifyState(base, baseSize, SAVE_STATE_MAGIC)) return false;
+    for (int i = 0; i < count; i++) {
+        if (!this->verifyState(deltas[i], deltaSizes[i], SAVE_STATE_DELTA_MAGIC)) return false;
+    }
+    // a delta that does not fit its base is found after the earlier ones are applied: go back to the current state then
+    // (the current state becomes the reference of the next delta)
+    size_t backupSize = this->getStateSize();
+    unsigned char* backup = (unsigned char*)malloc(backupSize);
+    if (!backup || !this->saveSnapshot(backup, backupSize)) {
+        if (backup) free(backup);
+        return false;
+    }
+    bool result = this->restoreState(base, baseSize);
+    for (int i = 0; i < count && result; i++) {
+        result = this->restoreState(deltas[i], deltaSizes[i]);
+    }
+    if (!result) this->restoreState(backup, backupSize);
+    free(backup);
+    return result;
+}
+
+bool TinyMSX::setRewindBuffer(unsigned int megaBytes)
+{
+    if (!megaBytes) {
+        this->rewindBuffer.release();
+        return true;
+    }
+    return this->rewindBuffer.setup((size_t)megaBytes * 1024 * 1024, this->writeState(NULL, 0, false, false));
+}
+
+unsigned int TinyMSX::rewind(unsigned int frames)
+{
+    frames = this->rewindBuffer.rewind(frames);
+    if (frames) this->restoreState(this->rewindBuffer.getSnapshot(), this->rewindBuffer.getStateSize());
+    return frames;
+}
+
+bool TinyMSX::seek(unsigned int frame)
+{
+    if (!this->rewindBuffer.getSnapshot() || frame < this->rewindBuffer.getOldestFrame() || this->rewindBuffer.getFrame() < frame) return false;
+    this->rewind(this->rewindBuffer.getFrame() - frame);
+    return true;
+}
+
+bool TinyMSX::restoreState(const void* data, size_t size)
+{
+    // the checksum is not verified (the data must be made by saveState), but the chunk headers, the payload sizes and the base of a delta are checked before changing the state
+    const unsigned char* d = (const unsigned char*)data;
+    if (!d || size < SAVE_STATE_HEADER_SIZE) return false;
+    bool delta = 0 == memcmp(d, SAVE_STATE_DELTA_MAGIC, 4);
+    if (!delta && 0 != memcmp(d, SAVE_STATE_MAGIC, 4)) return false;
+    if (SAVE_STATE_VERSION != (d[4] | d[5] << 8) || this->type != (d[6] | d[7] << 8)) return false;
+    size_t total = StateSerializer::getLE32(&d[8]);
+    if (total < SAVE_STATE_HEADER_SIZE || size < total) return false;
+    const unsigned char* chunks[STATE_CHUNK_MAX]; // headers
+    const unsigned char* payloads[STATE_CHUNK_MAX];
+    size_t payloadSizes[STATE_CHUNK_MAX];
+    int chunkCount = 0;
+    const char* ids[STATE_CHUNK_MAX];
+    int idCount = this->getStateChunks(ids, false);
+    int covered = 0;
+    bool hasBase = false;
+    size_t rawTotal = 0; // raw size of the compressed chunks
+    for (size_t ptr = SAVE_STATE_HEADER_SIZE; ptr < total;) {
+        if (total - ptr < SAVE_STATE_CHUNK_HEADER_SIZE || STATE_CHUNK_MAX <= chunkCount) return false;
+        unsigned int flags = StateSerializer::getLE32(&d[ptr + 4]);
+        size_t payload = StateSerializer::getLE32(&d[ptr + 8]);
+        if (total - ptr - SAVE_STATE_CHUNK_HEADER_SIZE < payload) return false;
+        if (flags & ~SAVE_STATE_CHUNK_LZ) return false; // unsupported flags
+        if (flags) {
+            if (payload < 4 || STATE_MEMORY_CHUNK_MAX < StateSerializer::getLE32(&d[ptr + SAVE_STATE_CHUNK_HEADER_SIZE])) return false;
+            rawTotal += StateSerializer::getLE32(&d[ptr + SAVE_STATE_CHUNK_HEADER_SIZE]);
+        }
+        for (int i = 0; i < idCount; i++) {
+            if (ids[i] && 0 == memcmp(&d[ptr], ids[i], 4)) {
+                ids[i] = NULL;
+                covered++;
+            }
+        }
+        if (0 == memcmp(&d[ptr], STATE_CHUNK_BASE, 4)) hasBase = true;
+        chunks[chunkCount] = &d[ptr];
+        payloads[chunkCount] = &d[ptr + SAVE_STATE_CHUNK_HEADER_SIZE];
+        payloadSizes[chunkCount++] = payload;
+        ptr += SAVE_STATE_CHUNK_HEADER_SIZE + payload;
+    }
+    if (delta && !hasBase) return false; // the base is checked by checkChunk
+    // expand the compressed chunks before changing the state
+    unsigned char* raw = NULL;
+    if (rawTotal) {
+        raw = (unsigned char*)malloc(rawTotal);
+        if (!raw) return false;
+    }
+    size_t rawPtr = 0;
+    for (int i = 0; i < chunkCount; i++) {
+        if (!StateSerializer::getLE32(&chunks[i][4])) continue;
+        size_t size = StateSerializer::getLE32(payloads[i]);
+        if (!StateSerializer::lzDecompress(&payloads[i][4], payloadSizes[i] - 4, &raw[rawPtr], size)) {
+            free(raw);
+            return false;
+        }
+        payloads[i] = &raw[rawPtr];
+        payloadSizes[i] = size;
+        rawPtr += size;
+    }
+    for (int i = 0; i < chunkCount; i++) {
+        if (!this->checkChunk((const char*)chunks[i], payloads[i], payloadSizes[i])) {
+            if (raw) free(raw);
+            return false;
         }
-        d += ds;
-        s -= ds;
     }
+    // overwrite in place (the state that is not covered by a full state starts from the reset state)
+    if (!delta && covered < idCount) this->reset();
+    bool result = true;
+    for (int i = 0; i < chunkCount && result; i++) {
+        StateSerializer s((void*)payloads[i], payloadSizes[i], true);
+        this->serializeChunk(&s, (const char*)chunks[i]); // unknown chunks are ignored
+        result = !s.hasError();
+    }
+    if (raw) free(raw);
+    if (!result) return false;
+    this->clearDirtyPages(); // the restored state is the reference of the next delta
+    this->baseHash = this->stateHash();
+    return true;
 }
@@ -34,53 +34,142 @@
 #include "msxslot_asc8x.hpp"
 #include "tms9918a.hpp"
 #include "sn76489.hpp"
+#include "blipbuf.hpp"
 #include "ay8910.hpp"
+#include "triplebuffer.hpp"
+#include "audioring.hpp"
+#include "vgmlogger.hpp"
+#include "romimage.hpp"
+#include "savestate.hpp"
+#include "rewindbuffer.hpp"
 
 class TinyMSX {
     private:
-        struct MsxBIOS {
-            unsigned char main[0x8000];
-        } bios;
+        RomImage* bios; // main BIOS of MSX1 (32KB, read only and shared)
         int type;
+        bool ready; // the color mode of the constructor is supported
         unsigned char pad[2];
         unsigned char specialKeyX[2];
         unsigned char specialKeyY[2];
-        unsigned char* rom;
+        RomImage* romImage;
+        unsigned char* rom; // read only (shared)
         size_t romSize;
         size_t ramSize;
-        short soundBuffer[65536];
-        unsigned short soundBufferCursor;
-        unsigned char tmpBuffer[1024 * 1024];
+        unsigned char* soundBuffer; // allocated when getSoundBuffer is used
+        size_t soundBufferCursor;   // bytes
+        int soundChannels;
+        int soundFormat;
+        void (*soundCallback)(void* arg, const void* data, size_t size);
+        void* soundCallbackArg;
+        size_t soundOverflowFrames;
+        unsigned int soundSampleRate;
+        int soundRateAdjust; // ppm
+        TinyMSXFrameInfo frameInfo;
+        TripleBuffer frames;
+        BlipBuffer blip;
+        AudioRing soundRing;
+        RewindBuffer rewindBuffer;
+        bool stateCompression;
+        unsigned long long baseHash; // state hash at the last save, restore or reset (the base of the next delta)
+        int runAheadFrames;
+        unsigned char* runAheadState; // snapshot of the current frame (allocated by setRunAhead)
+        size_t runAheadStateSize;
+        BlipBuffer* runAheadBlip; // the sound of the current frame is kept here while running ahead
+        unsigned int soundClock; // CPU clocks from the start of the current frame
+        VgmLogger vgm;
     public:
         TMS9918A* tms9918;
         SN76489 sn76489;
         AY8910 ay8910;
         unsigned char io[0x100];
         unsigned char ram[0x10000];
+        unsigned char ramDirty[0x10000 / SAVE_STATE_PAGE_SIZE]; // flags of the written pages (SAVE_STATE_DIRTY_*)
+        unsigned char sramDirty[0x2000 / SAVE_STATE_PAGE_SIZE]; // ASC8X SRAM pages
+        unsigned long long ramHash[0x10000 / SAVE_STATE_PAGE_SIZE]; // hash per page (updated by stateHash)
+        unsigned long long vramHash[0x4000 / SAVE_STATE_PAGE_SIZE];
+        unsigned long long sramHash[0x2000 / SAVE_STATE_PAGE_SIZE];
         MsxSlot slot;
         MsxSlotASC8 slotASC8;
         MsxSlotASC8X slotASC8X;
         Z80* cpu;
         TinyMSX(int type, const void* rom, size_t romSize, size_t ramSize, int colorMode);
+        TinyMSX(int type, RomImage* rom, size_t ramSize, int colorMode);
         ~TinyMSX();
+        TinyMSX* clone();
+        bool copyFrom(TinyMSX* source);
         bool loadBiosFromFile(const char* path);
         bool loadBiosFromMemory(void* bios, size_t size);
+        bool setBios(RomImage* bios);
         void setupSpecialKey1(unsigned char ascii, bool isTenKey = false);
         void setupSpecialKey2(unsigned char ascii, bool isTenKey = false);
         void reset();
-        void tick(unsigned char pad1, unsigned char pad2);
-        unsigned short* getDisplayBuffer() { return this->tms9918->display; }
+        void tick(unsigned char pad1, unsigned char pad2, TinyMSXFrameInfo* info = NULL);
+        const TinyMSXFrameInfo* getFrameInfo() { return &this->frameInfo; }
+        unsigned short* getDisplayBuffer() { return this->tms9918->display; } // NULL while setDisplayBuffer is used
         unsigned short getBackdropColor() { return this->tms9918->getBackdropColor(); }
+        const unsigned char* getDirtyLines() { return this->tms9918->dirtyLines; }
+        bool isDirtyLine(int y) { return this->tms9918->isDirtyLine(y); }
+        bool convertDisplayBuffer(void* buffer, int colorMode);
+        bool setDisplayBuffer(void* buffer, size_t pitch, int colorMode, bool border = true)
+        {
+            this->frames.setup(NULL, NULL, NULL);
+            if (border) {
+                return this->tms9918->setOutputBuffer(buffer, pitch, colorMode, 0, 0, TMS9918A_SCREEN_WIDTH, TMS9918A_SCREEN_HEIGHT);
+            } else {
+                return this->tms9918->setOutputBuffer(buffer, pitch, colorMode, TMS9918A_ACTIVE_X, TMS9918A_ACTIVE_Y, TMS9918A_ACTIVE_WIDTH, TMS9918A_ACTIVE_HEIGHT);
+            }
+        }
+        bool setDisplayBuffer(void* buffer, size_t pitch, int colorMode, int x, int y, int width, int height)
+        {
+            this->frames.setup(NULL, NULL, NULL);
+            return this->tms9918->setOutputBuffer(buffer, pitch, colorMode, x, y, width, height);
+        }
+        bool setTripleBuffer(void* buffer1, void* buffer2, void* buffer3, size_t pitch, int colorMode, bool border = true);
+        const void* acquireFrame(unsigned int* frameNumber = NULL) { return this->frames.acquire(frameNumber); }
         void* getSoundBuffer(size_t* size);
-        const void* saveState(size_t* size);
-        void loadState(const void* data, size_t size);
+        bool setSoundFormat(int sampleRate, int channels, int format);
+        bool setSoundRing(unsigned int latency);
+        void setSoundCallback(void (*callback)(void* arg, const void* data, size_t size), void* arg)
+        {
+            this->soundCallback = callback;
+            this->soundCallbackArg = arg;
+        }
+        size_t getSoundOverflowFrames() { return this->soundOverflowFrames; }
+        bool setSoundRateAdjust(int ppm);
+        unsigned int readSound(void* buffer, unsigned int frames) { return this->soundRing.read(buffer, frames); }
+        unsigned int getSoundLevel() { return this->soundRing.getLevel(); }
+        unsigned int getSoundUnderruns() { return this->soundRing.getUnderruns(); }
+        unsigned int getSoundOverruns() { return this->soundRing.getOverruns(); }
+        bool startVgmLog(const char* path);
+        void stopVgmLog() { this->vgm.close(); }
+        void setStateCompression(bool enabled) { this->stateCompression = enabled; }
+        size_t getStateSize() { return this->saveState(NULL, 0); }
+        size_t saveSnapshot(void* buffer, size_t size) { return this->writeState(buffer, size, false, false); } // for restoreState (no checksum and no compression, the delta reference is kept)
+        size_t saveState(void* buffer, size_t size) { return this->writeState(buffer, size, false, true); }
+        size_t getDeltaStateSize() { return this->saveDeltaState(NULL, 0); }
+        size_t saveDeltaState(void* buffer, size_t size) { return this->writeState(buffer, size, true, true); }
+        bool loadState(const void* data, size_t size);
+        bool loadStateChain(const void* base, size_t baseSize, const void* const* deltas, const size_t* deltaSizes, int count);
+        bool restoreState(const void* data, size_t size);
+        unsigned long long stateHash(bool incremental = true);
+        void resimulate(unsigned char pad1, unsigned char pad2);
+        void setStatusOnlyRendering(bool enabled) { this->tms9918->setStatusOnly(enabled); }
+        bool setRunAhead(int frames);
+        int getRunAhead() { return this->runAheadFrames; }
+        bool setRewindBuffer(unsigned int megaBytes);
+        unsigned int rewind(unsigned int frames);
+        bool seek(unsigned int frame);
+        unsigned int getRewindFrame() { return this->rewindBuffer.getFrame(); }
+        unsigned int getRewindOldestFrame() { return this->rewindBuffer.getOldestFrame(); }
         inline bool isSG1000() { return this->type == TINYMSX_TYPE_SG1000; }
         inline bool isMSX1() { return this->type == TINYMSX_TYPE_MSX1; }
         inline bool isMSX1_ASC8() { return this->type == TINYMSX_TYPE_MSX1_ASC8; }
         inline bool isMSX1_ASC8X() { return this->type == TINYMSX_TYPE_MSX1_ASC8X; }
         inline bool isMSX1Family() { return this->isMSX1() || this->isMSX1_ASC8() || this->isMSX1_ASC8X(); }
+        inline bool isReady() { return this->ready; } // false: the color mode is not supported (nothing is rendered)
 
     private:
+        void setup(int type, RomImage* rom, size_t ramSize, int colorMode);
         inline void setupSpecialKeyV(int n, int x, int y) {
             this->specialKeyX[n] = x;
             this->specialKeyY[n] = y;
@@ -91,8 +180,17 @@ class TinyMSX {
         inline unsigned char inPort(unsigned char port);
         inline void outPort(unsigned char port, unsigned char value);
         inline void consumeClock(int clocks);
-        inline bool loadSpecificSizeFile(const char* path, void* buffer, size_t size);
-        size_t calcAvairableRamSize();
+        inline void flushSound();
+        void setPads(unsigned char pad1, unsigned char pad2);
+        void runSilentFrame();
+        void runAhead();
+        inline void slot_addBios();
+        int getStateChunks(const char** ids, bool delta);
+        bool serializeChunk(StateSerializer* s, const char* id);
+        bool checkChunk(const char* id, const unsigned char* payload, size_t size);
+        void clearDirtyPages();
+        size_t writeState(void* buffer, size_t size, bool delta, bool reference);
+        size_t verifyState(const void* data, size_t size, const char* magic);
 
         inline void slot_init(unsigned char* rom) {
             if (this->isMSX1_ASC8()) this->slotASC8.init(rom);
@@ -156,10 +254,11 @@ class TinyMSX {
             else return 0xFF;
         }
 
-        inline void slot_write(unsigned short addr, unsigned char value) {
-            if (this->isMSX1()) this->slot.write(addr, value);
-            else if (this->isMSX1_ASC8()) this->slotASC8.write(addr, value);
-            else if (this->isMSX1_ASC8X()) this->slotASC8X.write(addr, value);
+        inline unsigned char* slot_write(unsigned short addr, unsigned char value) {
+            if (this->isMSX1()) return this->slot.write(addr, value);
+            else if (this->isMSX1_ASC8()) return this->slotASC8.write(addr, value);
+            else if (this->isMSX1_ASC8X()) return this->slotASC8X.write(addr, value);
+            else return NULL;
         }
 };
 
@@ -34,6 +34,25 @@
 
 #define TINYMSX_COLOR_MODE_RGB555 0
 #define TINYMSX_COLOR_MODE_RGB565 1
+#define TINYMSX_COLOR_MODE_INDEXED8 2 // 1 byte per pixel (color index: 0 ~ 15)
+#define TINYMSX_COLOR_MODE_INDEXED4 3 // 2 pixels per byte (the left pixel is the high nibble)
+#define TINYMSX_COLOR_MODE_ARGB8888 4 // 4 bytes per pixel (alpha = 0xFF, also usable as XRGB8888)
+#define TINYMSX_COLOR_MODE_XRGB8888 TINYMSX_COLOR_MODE_ARGB8888
+
+#define TINYMSX_SOUND_FORMAT_S16 0 // signed 16bit integer
+#define TINYMSX_SOUND_FORMAT_F32 1 // 32bit float (-1.0 ~ 1.0)
+
+#define TINYMSX_RUN_AHEAD_MAX 4 // maximum frames of the run-ahead
+
+// The result of a tick (timestamp of the frame start = cycleStart / clockRate seconds)
+typedef struct {
+    unsigned long long frameNumber; // number of the executed ticks since reset (1 = the first tick)
+    unsigned long long cycleStart;  // CPU clocks since reset at the start of the frame
+    unsigned long long cycleEnd;    // CPU clocks since reset at the end of the frame
+    unsigned int clockRate;         // CPU clocks per second (3579545)
+    unsigned int samples;           // sample frames produced by the frame (e.g. 735 or 736 at 44.1kHz)
+    unsigned long long sampleStart; // sample frames produced since reset before the frame
+} TinyMSXFrameInfo;
 
 #define TINYMSX_JOY_UP 0b00000001
 #define TINYMSX_JOY_DW 0b00000010
@@ -27,16 +27,62 @@
 #include "tinymsx.h"
 #include "tinymsx_gw.h"
 
-void* tinymsx_create(int type, const void* rom, size_t romSize, size_t ramSize, int colorMode) { return new TinyMSX(type, rom, romSize, ramSize, colorMode); }
+static void* created(TinyMSX* msx)
+{
+    if (msx->isReady()) return msx;
+    delete msx; // the color mode is not supported
+    return NULL;
+}
+
+void* tinymsx_create(int type, const void* rom, size_t romSize, size_t ramSize, int colorMode) { return created(new TinyMSX(type, rom, romSize, ramSize, colorMode)); }
+void* tinymsx_create_shared(int type, const void* romImage, size_t ramSize, int colorMode) { return created(new TinyMSX(type, (RomImage*)romImage, ramSize, colorMode)); }
+void* tinymsx_rom_from_file(const char* path) { return RomImage::fromFile(path); }
+void* tinymsx_rom_from_memory(const void* data, size_t size) { return RomImage::fromMemory(data, size); }
+void tinymsx_rom_release(const void* romImage) { ((RomImage*)romImage)->release(); }
 void tinymsx_destroy(const void* context) { delete (TinyMSX*)context; }
+void* tinymsx_clone(const void* context) { return ((TinyMSX*)context)->clone(); }
+int tinymsx_copy_from(const void* context, const void* source) { return ((TinyMSX*)context)->copyFrom((TinyMSX*)source) ? 1 : 0; }
 void tinymsx_reset(const void* context) { ((TinyMSX*)context)->reset(); }
 void tinymsx_tick(const void* context, unsigned char pad1, unsigned char pad2) { ((TinyMSX*)context)->tick(pad1, pad2); }
+void tinymsx_tick_info(const void* context, unsigned char pad1, unsigned char pad2, TinyMSXFrameInfo* info) { ((TinyMSX*)context)->tick(pad1, pad2, info); }
 unsigned short* tinymsx_display(const void* context) { return ((TinyMSX*)context)->getDisplayBuffer(); }
 void* tinymsx_sound(const void* context, size_t* size) { return ((TinyMSX*)context)->getSoundBuffer(size); }
-const void* tinymsx_save(const void* context, size_t* size) { return ((TinyMSX*)context)->saveState(size); }
-void tinymsx_load(const void* context, const void* data, size_t size) { ((TinyMSX*)context)->loadState(data, size); }
+void tinymsx_set_sound_callback(const void* context, void (*callback)(void* arg, const void* data, size_t size), void* arg) { ((TinyMSX*)context)->setSoundCallback(callback, arg); }
+size_t tinymsx_sound_overflow_frames(const void* context) { return ((TinyMSX*)context)->getSoundOverflowFrames(); }
+int tinymsx_set_sound_rate_adjust(const void* context, int ppm) { return ((TinyMSX*)context)->setSoundRateAdjust(ppm) ? 1 : 0; }
+int tinymsx_set_sound_ring(const void* context, unsigned int latency) { return ((TinyMSX*)context)->setSoundRing(latency) ? 1 : 0; }
+unsigned int tinymsx_read_sound(const void* context, void* buffer, unsigned int frames) { return ((TinyMSX*)context)->readSound(buffer, frames); }
+unsigned int tinymsx_sound_underruns(const void* context) { return ((TinyMSX*)context)->getSoundUnderruns(); }
+unsigned int tinymsx_sound_overruns(const void* context) { return ((TinyMSX*)context)->getSoundOverruns(); }
+int tinymsx_start_vgm_log(const void* context, const char* path) { return ((TinyMSX*)context)->startVgmLog(path) ? 1 : 0; }
+void tinymsx_stop_vgm_log(const void* context) { ((TinyMSX*)context)->stopVgmLog(); }
+int tinymsx_set_sound_format(const void* context, int sampleRate, int channels, int format) { return ((TinyMSX*)context)->setSoundFormat(sampleRate, channels, format) ? 1 : 0; }
+void tinymsx_set_state_compression(const void* context, int enabled) { ((TinyMSX*)context)->setStateCompression(enabled ? true : false); }
+size_t tinymsx_state_size(const void* context) { return ((TinyMSX*)context)->getStateSize(); }
+size_t tinymsx_save(const void* context, void* buffer, size_t size) { return ((TinyMSX*)context)->saveState(buffer, size); }
+int tinymsx_load(const void* context, const void* data, size_t size) { return ((TinyMSX*)context)->loadState(data, size) ? 1 : 0; }
+int tinymsx_restore(const void* context, const void* data, size_t size) { return ((TinyMSX*)context)->restoreState(data, size) ? 1 : 0; }
+size_t tinymsx_delta_state_size(const void* context) { return ((TinyMSX*)context)->getDeltaStateSize(); }
+size_t tinymsx_save_delta(const void* context, void* buffer, size_t size) { return ((TinyMSX*)context)->saveDeltaState(buffer, size); }
+unsigned long long tinymsx_state_hash(const void* context, int incremental) { return ((TinyMSX*)context)->stateHash(incremental ? true : false); }
+int tinymsx_set_run_ahead(const void* context, int frames) { return ((TinyMSX*)context)->setRunAhead(frames) ? 1 : 0; }
+size_t tinymsx_save_snapshot(const void* context, void* buffer, size_t size) { return ((TinyMSX*)context)->saveSnapshot(buffer, size); }
+void tinymsx_resimulate(const void* context, unsigned char pad1, unsigned char pad2) { ((TinyMSX*)context)->resimulate(pad1, pad2); }
+void tinymsx_set_status_only_rendering(const void* context, int enabled) { ((TinyMSX*)context)->setStatusOnlyRendering(enabled ? true : false); }
+int tinymsx_set_rewind_buffer(const void* context, unsigned int megaBytes) { return ((TinyMSX*)context)->setRewindBuffer(megaBytes) ? 1 : 0; }
+unsigned int tinymsx_rewind(const void* context, unsigned int frames) { return ((TinyMSX*)context)->rewind(frames); }
+int tinymsx_seek(const void* context, unsigned int frame) { return ((TinyMSX*)context)->seek(frame) ? 1 : 0; }
+unsigned int tinymsx_rewind_frame(const void* context) { return ((TinyMSX*)context)->getRewindFrame(); }
+unsigned int tinymsx_rewind_oldest_frame(const void* context) { return ((TinyMSX*)context)->getRewindOldestFrame(); }
+int tinymsx_load_chain(const void* context, const void* base, size_t baseSize, const void* const* deltas, const size_t* deltaSizes, int count) { return ((TinyMSX*)context)->loadStateChain(base, baseSize, deltas, deltaSizes, count) ? 1 : 0; }
 unsigned short tinymsx_backdrop(const void* context) { return ((TinyMSX*)context)->getBackdropColor(); }
+const unsigned char* tinymsx_dirty_lines(const void* context) { return ((TinyMSX*)context)->getDirtyLines(); }
+int tinymsx_set_display(const void* context, void* buffer, size_t pitch, int colorMode, int border) { return ((TinyMSX*)context)->setDisplayBuffer(buffer, pitch, colorMode, border ? true : false) ? 1 : 0; }
+int tinymsx_set_triple_buffer(const void* context, void* buffer1, void* buffer2, void* buffer3, size_t pitch, int colorMode, int border) { return ((TinyMSX*)context)->setTripleBuffer(buffer1, buffer2, buffer3, pitch, colorMode, border ? true : false) ? 1 : 0; }
+const void* tinymsx_acquire_frame(const void* context, unsigned int* frameNumber) { return ((TinyMSX*)context)->acquireFrame(frameNumber); }
+int tinymsx_convert_display(const void* context, void* buffer, int colorMode) { return ((TinyMSX*)context)->convertDisplayBuffer(buffer, colorMode) ? 1 : 0; }
 void tinymsx_load_bios_msx1_main(const void* context, void* bios, size_t size) { ((TinyMSX*)context)->loadBiosFromMemory(bios, size); }
+int tinymsx_set_bios(const void* context, const void* biosImage) { return ((TinyMSX*)context)->setBios((RomImage*)biosImage) ? 1 : 0; }
 void tinymsx_setup_special_key1(const void* context, unsigned char c, int isTenKey) { ((TinyMSX*)context)->setupSpecialKey1(c, isTenKey); }
 void tinymsx_setup_special_key2(const void* context, unsigned char c, int isTenKey) { ((TinyMSX*)context)->setupSpecialKey2(c, isTenKey); }
 unsigned char* tinymsx_get_vram(const void* context) { return ((TinyMSX*)context)->tms9918->ctx.ram; }
@@ -34,15 +34,54 @@ extern "C" {
 #endif
 
 void* tinymsx_create(int type, const void* rom, size_t romSize, size_t ramSize, int colorMode);
+void* tinymsx_create_shared(int type, const void* romImage, size_t ramSize, int colorMode);
+void* tinymsx_rom_from_file(const char* path);
+void* tinymsx_rom_from_memory(const void* data, size_t size);
+void tinymsx_rom_release(const void* romImage);
 void tinymsx_destroy(const void* context);
+void* tinymsx_clone(const void* context);
+int tinymsx_copy_from(const void* context, const void* source);
 void tinymsx_reset(const void* context);
 void tinymsx_tick(const void* context, unsigned char pad1, unsigned char pad2);
+void tinymsx_tick_info(const void* context, unsigned char pad1, unsigned char pad2, TinyMSXFrameInfo* info);
 unsigned short* tinymsx_display(const void* context);
 void* tinymsx_sound(const void* context, size_t* size);
-const void* tinymsx_save(const void* context, size_t* size);
-void tinymsx_load(const void* context, const void* data, size_t size);
+int tinymsx_set_sound_format(const void* context, int sampleRate, int channels, int format);
+void tinymsx_set_sound_callback(const void* context, void (*callback)(void* arg, const void* data, size_t size), void* arg);
+size_t tinymsx_sound_overflow_frames(const void* context);
+int tinymsx_set_sound_rate_adjust(const void* context, int ppm);
+int tinymsx_set_sound_ring(const void* context, unsigned int latency);
+unsigned int tinymsx_read_sound(const void* context, void* buffer, unsigned int frames);
+unsigned int tinymsx_sound_underruns(const void* context);
+unsigned int tinymsx_sound_overruns(const void* context);
+int tinymsx_start_vgm_log(const void* context, const char* path);
+void tinymsx_stop_vgm_log(const void* context);
+void tinymsx_set_state_compression(const void* context, int enabled);
+size_t tinymsx_state_size(const void* context);
+size_t tinymsx_save(const void* context, void* buffer, size_t size);
+int tinymsx_load(const void* context, const void* data, size_t size);
+int tinymsx_restore(const void* context, const void* data, size_t size);
+size_t tinymsx_delta_state_size(const void* context);
+size_t tinymsx_save_delta(const void* context, void* buffer, size_t size);
+unsigned long long tinymsx_state_hash(const void* context, int incremental);
+int tinymsx_set_run_ahead(const void* context, int frames);
+size_t tinymsx_save_snapshot(const void* context, void* buffer, size_t size);
+void tinymsx_resimulate(const void* context, unsigned char pad1, unsigned char pad2);
+void tinymsx_set_status_only_rendering(const void* context, int enabled);
+int tinymsx_set_rewind_buffer(const void* context, unsigned int megaBytes);
+unsigned int tinymsx_rewind(const void* context, unsigned int frames);
+int tinymsx_seek(const void* context, unsigned int frame);
+unsigned int tinymsx_rewind_frame(const void* context);
+unsigned int tinymsx_rewind_oldest_frame(const void* context);
+int tinymsx_load_chain(const void* context, const void* base, size_t baseSize, const void* const* deltas, const size_t* deltaSizes, int count);
 unsigned short tinymsx_backdrop(const void* context);
+const unsigned char* tinymsx_dirty_lines(const void* context);
+int tinymsx_convert_display(const void* context, void* buffer, int colorMode);
+int tinymsx_set_display(const void* context, void* buffer, size_t pitch, int colorMode, int border);
+int tinymsx_set_triple_buffer(const void* context, void* buffer1, void* buffer2, void* buffer3, size_t pitch, int colorMode, int border);
+const void* tinymsx_acquire_frame(const void* context, unsigned int* frameNumber);
 void tinymsx_load_bios_msx1_main(const void* context, void* bios, size_t size);
+int tinymsx_set_bios(const void* context, const void* biosImage);
 void tinymsx_load_bios_msx1_logo(const void* context, void* bios, size_t size);
 void tinymsx_setup_special_key1(const void* context, unsigned char c, int isTenKey);
 void tinymsx_setup_special_key2(const void* context, unsigned char c, int isTenKey);
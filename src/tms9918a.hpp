@@ -28,10 +28,18 @@
 #ifndef INCLUDE_TMS9918A_HPP
 #define INCLUDE_TMS9918A_HPP
 
+#include <stdlib.h>
 #include <string.h>
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
 
 #define TMS9918A_SCREEN_WIDTH 284
 #define TMS9918A_SCREEN_HEIGHT 240
+#define TMS9918A_ACTIVE_X 13
+#define TMS9918A_ACTIVE_Y 24
+#define TMS9918A_ACTIVE_WIDTH 256
+#define TMS9918A_ACTIVE_HEIGHT 192
 
 /**
  * Note about the Screen Resolution: 284 x 240
@@ -62,13 +70,48 @@
 class TMS9918A
 {
   private:
+    int colorMode;
     void* arg;
     void (*detectBlank)(void* arg);
     void (*detectBreak)(void* arg);
 
+    // The scanline is rendered as the color indices, and converted to the output at the end of the line.
+    unsigned char lineBuffer[TMS9918A_SCREEN_WIDTH];
+
+    // Output target of the rendered lines (the internal display or a caller-provided buffer)
+    struct Output {
+        void* buffer;
+        size_t pitch; // bytes per line
+        int colorMode;
+        int x;
+        int y;
+        int width;
+        int height;
+        unsigned int palette[16];
+    } output;
+
+    // Scanline dirty tracking (index: display line number 0 ~ 239)
+    // A line is rendered only when a VRAM byte or a register that affects it was changed.
+    // Sprites are checked with a signature of the drawn sprites per line.
+    bool dirtyAll;
+    bool statusOnly; // the pixels are not rendered (the sprites are evaluated for the status register)
+    unsigned char lineDirty[TMS9918A_SCREEN_HEIGHT];
+    unsigned char renderedLines[TMS9918A_SCREEN_HEIGHT / 8];
+    unsigned int spriteSignature[192];
+
+    // Frame number of the last render per line (never reset, used to refresh a swapped output buffer)
+    unsigned int frameCount;
+    unsigned int lineFrame[TMS9918A_SCREEN_HEIGHT];
+
   public:
-    unsigned short display[TMS9918A_SCREEN_WIDTH * TMS9918A_SCREEN_HEIGHT];
+    // RGB555 or RGB565: 284 x 240 x 2 bytes
+    // INDEXED8: 284 x 240 x 1 byte (color index per byte)
+    // INDEXED4: 142 x 240 x 1 byte (two color indices per byte, the left pixel is the high nibble)
+    // NULL while a caller-provided output buffer is used (allocated when the internal display is restored)
+    unsigned short* display;
     unsigned short palette[16];
+    unsigned char dirtyLines[TMS9918A_SCREEN_HEIGHT / 8]; // bitmap of the lines updated in the last frame
+    unsigned char vramDirty[0x4000 / 256];                // VRAM pages (256 bytes) written: all flags are set, the owner clears each flag
 
     struct Context {
         int bobo;
@@ -88,38 +131,209 @@ class TMS9918A
 
     TMS9918A(int colorMode, void* arg, void (*detectBlank)(void*), void (*detectBreak)(void*))
     {
+        this->colorMode = colorMode;
         this->arg = arg;
         this->detectBlank = detectBlank;
         this->detectBreak = detectBreak;
-        unsigned int rgb[16] = {0x000000, 0x000000, 0x3EB849, 0x74D07D, 0x5955E0, 0x8076F1, 0xB95E51, 0x65DBEF, 0xDB6559, 0xFF897D, 0xCCC35E, 0xDED087, 0x3AA241, 0xB766B5, 0xCCCCCC, 0xFFFFFF};
+        for (int i = 0; i < 16; i++) {
+            this->palette[i] = (unsigned short)getColor(colorMode, i);
+        }
+        this->frameCount = 1;
+        this->statusOnly = false;
+        memset(this->lineFrame, 0, sizeof(this->lineFrame));
+        this->display = NULL;
+        this->output.buffer = NULL; // no output if the color mode is not supported (nothing is rendered)
+        this->setOutputBuffer(NULL, 0, colorMode, 0, 0, TMS9918A_SCREEN_WIDTH, TMS9918A_SCREEN_HEIGHT);
+        this->reset();
+    }
+
+    ~TMS9918A()
+    {
+        if (this->display) free(this->display);
+    }
+
+    inline unsigned int getFrameCount() { return this->frameCount; }
+    inline bool hasOutput() { return NULL != this->output.buffer; } // false if the color mode is not supported
+
+    /**
+     * Switch the output buffer keeping the format and the crop rectangle.
+     * renderedFrame is the getFrameCount() value when the buffer was filled last time (0: never),
+     * so only the lines rendered after that frame are written again.
+     */
+    void swapOutputBuffer(void* buffer, unsigned int renderedFrame)
+    {
+        this->output.buffer = buffer;
+        for (int y = 0; y < TMS9918A_SCREEN_HEIGHT; y++) {
+            if (renderedFrame <= this->lineFrame[y]) this->lineDirty[y] = 1;
+        }
+    }
+
+    /**
+     * Render directly into a caller-provided buffer instead of the display.
+     * - buffer: NULL restores the internal display (the internal display is released while the caller's buffer is used)
+     * - pitch: bytes per line
+     * - colorMode: 0 (RGB555), 1 (RGB565), 2 (INDEXED8), 3 (INDEXED4) or 4 (ARGB8888, also usable as XRGB8888)
+     * - x, y, width, height: crop rectangle in the 284x240 screen (TMS9918A_ACTIVE_* is the active area only)
+     * Only the updated lines are written to the buffer, so the buffer must keep the previous frame.
+     */
+    bool setOutputBuffer(void* buffer, size_t pitch, int colorMode, int x, int y, int width, int height)
+    {
+        if (!buffer) {
+            if (this->colorMode < 0 || 4 < this->colorMode) return false;
+            if (!this->display) {
+                this->display = (unsigned short*)calloc(TMS9918A_SCREEN_HEIGHT, getLineSize(this->colorMode, TMS9918A_SCREEN_WIDTH));
+                if (!this->display) return false;
+            }
+            buffer = this->display;
+            colorMode = this->colorMode;
+            x = 0;
+            y = 0;
+            width = TMS9918A_SCREEN_WIDTH;
+            height = TMS9918A_SCREEN_HEIGHT;
+            pitch = getLineSize(colorMode, width);
+        }
+        if (colorMode < 0 || 4 < colorMode) return false;
+        if (x < 0 || y < 0 || width < 1 || height < 1) return false;
+        if (TMS9918A_SCREEN_WIDTH < x + width || TMS9918A_SCREEN_HEIGHT < y + height) return false;
+        if (pitch < getLineSize(colorMode, width)) return false;
+        if (this->display && buffer != this->display) {
+            free(this->display);
+            this->display = NULL;
+        }
+        this->output.buffer = buffer;
+        this->output.pitch = pitch;
+        this->output.colorMode = colorMode;
+        this->output.x = x;
+        this->output.y = y;
+        this->output.width = width;
+        this->output.height = height;
+        for (int i = 0; i < 16; i++) {
+            this->output.palette[i] = getColor(colorMode, i);
+        }
+        this->invalidateLines();
+        return true;
+    }
+
+    static size_t getLineSize(int colorMode, int width)
+    {
         switch (colorMode) {
-            case 0:
-                for (int i = 0; i < 16; i++) {
-                    this->palette[i] = 0;
-                    this->palette[i] |= (rgb[i] & 0b111110000000000000000000) >> 9;
-                    this->palette[i] |= (rgb[i] & 0b000000001111100000000000) >> 6;
-                    this->palette[i] |= (rgb[i] & 0b000000000000000011111000) >> 3;
+            case 2: return width;           // INDEXED8
+            case 3: return (width + 1) / 2; // INDEXED4
+            case 4: return width * 4;       // ARGB8888
+            default: return width * 2;      // RGB555 or RGB565
+        }
+    }
+
+    static unsigned int getColor(int colorMode, int index)
+    {
+        static const unsigned int rgb[16] = {0x000000, 0x000000, 0x3EB849, 0x74D07D, 0x5955E0, 0x8076F1, 0xB95E51, 0x65DBEF, 0xDB6559, 0xFF897D, 0xCCC35E, 0xDED087, 0x3AA241, 0xB766B5, 0xCCCCCC, 0xFFFFFF};
+        unsigned int c = rgb[index & 0x0F];
+        switch (colorMode) {
+            case 0: // RGB555
+                return (c & 0b111110000000000000000000) >> 9 | (c & 0b000000001111100000000000) >> 6 | (c & 0b000000000000000011111000) >> 3;
+            case 1: // RGB565
+                return (c & 0b111110000000000000000000) >> 8 | (c & 0b000000001111110000000000) >> 5 | (c & 0b000000000000000011111000) >> 3;
+            case 2: // INDEXED8
+            case 3: // INDEXED4
+                return index & 0x0F;
+            case 4: // ARGB8888
+                return 0xFF000000 | c;
+            default:
+                return 0;
+        }
+    }
+
+    /**
+     * Convert the indexed pixels (INDEXED8 or INDEXED4) to RGB555, RGB565 or ARGB8888
+     * (the display buffer of the indexed color mode can be converted when it is needed)
+     */
+    static void convertIndexedPixels(int srcColorMode, const void* src, int dstColorMode, void* dst, int pixels)
+    {
+        const unsigned char* s = (const unsigned char*)src;
+        unsigned int pal[16];
+        for (int i = 0; i < 16; i++) pal[i] = getColor(dstColorMode, i);
+        int i = 0;
+#ifdef __SSSE3__
+        // 16 pixels per step: the palette is split into the byte planes, and pshufb looks up each plane by the indices
+        unsigned char planes[4][16];
+        for (int c = 0; c < 16; c++) {
+            for (int b = 0; b < 4; b++) planes[b][c] = (unsigned char)(pal[c] >> (b * 8));
+        }
+        const __m128i p0 = _mm_loadu_si128((const __m128i*)planes[0]);
+        const __m128i p1 = _mm_loadu_si128((const __m128i*)planes[1]);
+        const __m128i p2 = _mm_loadu_si128((const __m128i*)planes[2]);
+        const __m128i p3 = _mm_loadu_si128((const __m128i*)planes[3]);
+        const __m128i nibble = _mm_set1_epi8(0x0F);
+        for (; i + 16 <= pixels; i += 16) {
+            __m128i index;
+            if (3 == srcColorMode) {
+                __m128i packed = _mm_loadl_epi64((const __m128i*)&s[i / 2]);
+                index = _mm_unpacklo_epi8(_mm_and_si128(_mm_srli_epi16(packed, 4), nibble), _mm_and_si128(packed, nibble));
+            } else {
+                index = _mm_and_si128(_mm_loadu_si128((const __m128i*)&s[i]), nibble);
+            }
+            __m128i lo = _mm_unpacklo_epi8(_mm_shuffle_epi8(p0, index), _mm_shuffle_epi8(p1, index));
+            __m128i hi = _mm_unpackhi_epi8(_mm_shuffle_epi8(p0, index), _mm_shuffle_epi8(p1, index));
+            if (4 == dstColorMode) {
+                __m128i lo2 = _mm_unpacklo_epi8(_mm_shuffle_epi8(p2, index), _mm_shuffle_epi8(p3, index));
+                __m128i hi2 = _mm_unpackhi_epi8(_mm_shuffle_epi8(p2, index), _mm_shuffle_epi8(p3, index));
+                __m128i* d = (__m128i*)&((unsigned int*)dst)[i];
+                _mm_storeu_si128(d, _mm_unpacklo_epi16(lo, lo2));
+                _mm_storeu_si128(d + 1, _mm_unpackhi_epi16(lo, lo2));
+                _mm_storeu_si128(d + 2, _mm_unpacklo_epi16(hi, hi2));
+                _mm_storeu_si128(d + 3, _mm_unpackhi_epi16(hi, hi2));
+            } else {
+                __m128i* d = (__m128i*)&((unsigned short*)dst)[i];
+                _mm_storeu_si128(d, lo);
+                _mm_storeu_si128(d + 1, hi);
+            }
+        }
+#endif
+        // the remaining pixels (all pixels without SSSE3): i is even here
+        if (4 == dstColorMode) {
+            unsigned int* d = (unsigned int*)dst;
+            if (3 == srcColorMode) {
+                for (; i + 1 < pixels; i += 2) {
+                    d[i] = pal[s[i / 2] >> 4];
+                    d[i + 1] = pal[s[i / 2] & 0x0F];
                 }
-                break;
-            case 1:
-                for (int i = 0; i < 16; i++) {
-                    this->palette[i] = 0;
-                    this->palette[i] |= (rgb[i] & 0b111110000000000000000000) >> 8;
-                    this->palette[i] |= (rgb[i] & 0b000000001111110000000000) >> 5;
-                    this->palette[i] |= (rgb[i] & 0b000000000000000011111000) >> 3;
+                if (i < pixels) d[i] = pal[s[i / 2] >> 4];
+            } else {
+                for (; i < pixels; i++) d[i] = pal[s[i] & 0x0F];
+            }
+        } else {
+            unsigned short* d = (unsigned short*)dst;
+            if (3 == srcColorMode) {
+                for (; i + 1 < pixels; i += 2) {
+                    d[i] = (unsigned short)pal[s[i / 2] >> 4];
+                    d[i + 1] = (unsigned short)pal[s[i / 2] & 0x0F];
                 }
-                break;
-            default:
-                memset(this->palette, 0, sizeof(this->palette));
+                if (i < pixels) d[i] = (unsigned short)pal[s[i / 2] >> 4];
+            } else {
+                for (; i < pixels; i++) d[i] = (unsigned short)pal[s[i] & 0x0F];
+            }
         }
-        this->reset();
     }
 
     void reset()
     {
-        memset(display, 0, sizeof(display));
+        if (this->display) memset(this->display, 0, getLineSize(this->colorMode, TMS9918A_SCREEN_WIDTH) * TMS9918A_SCREEN_HEIGHT);
         memset(&ctx, 0, sizeof(ctx));
+        this->invalidateLines();
+        memset(this->renderedLines, 0, sizeof(this->renderedLines));
+        memset(this->dirtyLines, 0xFF, sizeof(this->dirtyLines));
+        memset(this->vramDirty, 0xFF, sizeof(this->vramDirty));
+    }
+
+    inline void invalidateLines() { this->dirtyAll = true; }
+
+    // skip the rendering (e.g. the resimulated frames): all lines are rendered again after it is disabled
+    inline void setStatusOnly(bool statusOnly)
+    {
+        if (this->statusOnly && !statusOnly) this->invalidateLines();
+        this->statusOnly = statusOnly;
     }
+    inline bool isDirtyLine(int y) { return this->dirtyLines[y >> 3] & (1 << (y & 7)) ? true : false; }
 
     inline int getVideoMode()
     {
@@ -134,25 +348,28 @@ class TMS9918A
     inline bool isEnabledExternalVideoInput() { return ctx.reg[0] & 0b00000001 ? true : false; }
     inline bool isEnabledScreen() { return ctx.reg[1] & 0b01000000 ? true : false; }
     inline bool isEnabledInterrupt() { return ctx.reg[1] & 0b00100000 ? true : false; }
+    inline int getColorMode() { return colorMode; }
+    inline int getOutputColorMode() { return this->output.colorMode; }
     inline unsigned short getBackdropColor() { return palette[ctx.reg[7] & 0b00001111]; }
 
     inline void tick()
     {
         this->ctx.countH++;
-        // render backdrop border
-        if (3 <= this->ctx.countV && this->ctx.countV < 3 + TMS9918A_SCREEN_HEIGHT) {
-            if (24 <= this->ctx.countH && this->ctx.countH < 24 + TMS9918A_SCREEN_WIDTH) {
-                int dcur = (this->ctx.countV - 3) * TMS9918A_SCREEN_WIDTH + this->ctx.countH - 24;
-                this->display[dcur] = this->getBackdropColor();
-            } else if (24 + TMS9918A_SCREEN_WIDTH == this->ctx.countH) {
-                this->renderScanline(this->ctx.countV - 27);
-            }
+        if (this->dirtyAll) {
+            memset(this->lineDirty, 1, sizeof(this->lineDirty));
+            this->dirtyAll = false;
+        }
+        // render the scanline (with the backdrop border) at the end of the visible area
+        if (3 <= this->ctx.countV && this->ctx.countV < 3 + TMS9918A_SCREEN_HEIGHT && 24 + TMS9918A_SCREEN_WIDTH == this->ctx.countH) {
+            this->renderScanline(this->ctx.countV - 27);
         }
         // delay write the VRAM
         if (this->ctx.writeWait) {
             this->ctx.writeWait--;
             if (0 == this->ctx.writeWait) {
                 this->ctx.ram[this->ctx.writeAddr] = this->ctx.readBuffer;
+                this->vramDirty[this->ctx.writeAddr >> 8] = 0xFF;
+                this->markDirtyLines(this->ctx.writeAddr);
             }
         }
         // sync blank or end-of-frame
@@ -167,6 +384,9 @@ class TMS9918A
                     break;
                 case 262:
                     this->ctx.countV -= 262;
+                    memcpy(this->dirtyLines, this->renderedLines, sizeof(this->dirtyLines));
+                    memset(this->renderedLines, 0, sizeof(this->renderedLines));
+                    this->frameCount++;
                     this->detectBreak(this->arg);
                     break;
             }
@@ -220,11 +440,71 @@ class TMS9918A
   private:
     inline void renderScanline(int lineNumber)
     {
+        int y = lineNumber + 24;
+        if (this->statusOnly) {
+            int mode = this->getVideoMode();
+            if (0 <= lineNumber && lineNumber < 192 && this->isEnabledScreen() && (0 == mode || 2 == mode)) {
+                this->renderSprites(lineNumber, false);
+            }
+            return;
+        }
         // TODO: Several modes (1, 3, undocumented) are not implemented
-        if (0 <= lineNumber && lineNumber < 192 && this->isEnabledScreen()) {
-            switch (this->getVideoMode()) {
-                case 0: this->renderScanlineMode0(lineNumber); break;
-                case 2: this->renderScanlineMode2(lineNumber); break;
+        int mode = this->getVideoMode();
+        bool active = 0 <= lineNumber && lineNumber < 192 && this->isEnabledScreen() && (0 == mode || 2 == mode);
+        if (active && !this->lineDirty[y]) {
+            // evaluate the sprites to update the status register and to detect the sprite changes
+            if (this->renderSprites(lineNumber, false) != this->spriteSignature[lineNumber]) {
+                this->lineDirty[y] = 1;
+            }
+        }
+        if (this->lineDirty[y]) {
+            // the whole line is drawn here: the line buffer still has the pixels of the last rendered line
+            memset(this->lineBuffer, this->ctx.reg[7] & 0b00001111, sizeof(this->lineBuffer));
+            if (active) {
+                if (0 == mode) {
+                    this->renderScanlineMode0(lineNumber);
+                } else {
+                    this->renderScanlineMode2(lineNumber);
+                }
+            }
+            this->flushLine(y);
+            this->lineFrame[y] = this->frameCount;
+            this->lineDirty[y] = 0;
+            this->renderedLines[y >> 3] |= 1 << (y & 7);
+        }
+    }
+
+    inline void flushLine(int y)
+    {
+        y -= this->output.y;
+        if (!this->output.buffer || y < 0 || this->output.height <= y) return;
+        const unsigned char* src = &this->lineBuffer[this->output.x];
+        const int width = this->output.width;
+        void* dst = (unsigned char*)this->output.buffer + y * this->output.pitch;
+        switch (this->output.colorMode) {
+            case 2: // INDEXED8
+                memcpy(dst, src, width);
+                break;
+            case 3: { // INDEXED4
+                unsigned char* d = (unsigned char*)dst;
+                for (int i = 0; i < width / 2; i++) {
+                    d[i] = src[i * 2] << 4 | src[i * 2 + 1];
+                }
+                if (width & 1) d[width / 2] = src[width - 1] << 4;
+                break;
+            }
+            case 4: { // ARGB8888
+                unsigned int* d = (unsigned int*)dst;
+                for (int i = 0; i < width; i++) {
+                    d[i] = this->output.palette[src[i]];
+                }
+                break;
+            }
+            default: { // RGB555 or RGB565
+                unsigned short* d = (unsigned short*)dst;
+                for (int i = 0; i < width; i++) {
+                    d[i] = (unsigned short)this->output.palette[src[i]];
+                }
             }
         }
     }
@@ -255,7 +535,11 @@ class TMS9918A
         bool externalVideoInput = this->isEnabledExternalVideoInput();
 #endif
         bool previousInterrupt = this->isEnabledInterrupt();
-        this->ctx.reg[this->ctx.tmpAddr[1] & 0b00001111] = this->ctx.tmpAddr[0];
+        int rn = this->ctx.tmpAddr[1] & 0b00001111;
+        if (this->ctx.reg[rn] != this->ctx.tmpAddr[0]) {
+            this->invalidateLines();
+        }
+        this->ctx.reg[rn] = this->ctx.tmpAddr[0];
         if (!previousInterrupt && this->isEnabledInterrupt() && this->ctx.stat & 0x80) {
             this->detectBlank(this->arg);
         }
@@ -286,10 +570,70 @@ class TMS9918A
 #endif
     }
 
-    inline int getDisplayAddrFromActiveLineNumber(int lineNumber)
+    inline void markDirtyLine(int lineNumber) { this->lineDirty[lineNumber + 24] = 1; }
+
+    inline void markDirtyLinesByPixelLine(int pixelLine, int from, int to)
     {
-        // left border (13px) + top border (24px)
-        return lineNumber * TMS9918A_SCREEN_WIDTH + 13 + 24 * TMS9918A_SCREEN_WIDTH;
+        for (int i = from + pixelLine; i < to; i += 8) this->markDirtyLine(i);
+    }
+
+    inline void markDirtyLines(unsigned short addr)
+    {
+        int na = addr - ((this->ctx.reg[2] & 0b00001111) << 10);
+        if (0 <= na && na < 768) {
+            for (int i = 0; i < 8; i++) this->markDirtyLine(na / 32 * 8 + i);
+        }
+        switch (this->getVideoMode()) {
+            case 0: {
+                int pa = addr - ((this->ctx.reg[4] & 0b00000111) << 11);
+                int ca = addr - (this->ctx.reg[3] << 6);
+                if (0 <= pa && pa < 0x800) this->markDirtyLinesByPixelLine(pa & 7, 0, 192);
+                if (0 <= ca && ca < 32) this->invalidateLines();
+                break;
+            }
+            case 2: {
+                int pa = addr - ((this->ctx.reg[4] & 0b00000100) << 11);
+                int ca = addr - ((this->ctx.reg[3] & 0b10000000) << 6);
+                if (0 <= pa && pa < 0x1800) {
+                    if ((this->ctx.reg[4] & 0b00000011) == 0b00000011) {
+                        this->markDirtyLinesByPixelLine(pa & 7, (pa >> 11) * 64, (pa >> 11) * 64 + 64);
+                    } else {
+                        this->markDirtyLinesByPixelLine(pa & 7, 0, 192);
+                    }
+                }
+                if (0 <= ca && ca < 0x1800) {
+                    if ((this->ctx.reg[3] & 0b01111111) == 0b01111111) {
+                        this->markDirtyLinesByPixelLine(ca & 7, (ca >> 11) * 64, (ca >> 11) * 64 + 64);
+                    } else {
+                        this->markDirtyLinesByPixelLine(ca & 7, 0, 192);
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    // decode a pattern row (8 pixels) to the color indices: the pattern bits select the foreground or background bytes
+    // (no per-row cache of the decoded pixels: the decode costs the same as a cache hit, and unchanged lines are not rendered)
+    inline void decodeRow(unsigned char* dst, unsigned char ptn, unsigned char c, int bd)
+    {
+        static const unsigned long long* expand = makeExpandTable();
+        unsigned long long fg = (c & 0xF0 ? c >> 4 : bd) * 0x0101010101010101ULL;
+        unsigned long long bg = (c & 0x0F ? c & 0x0F : bd) * 0x0101010101010101ULL;
+        unsigned long long row = (fg & expand[ptn]) | (bg & ~expand[ptn]);
+        memcpy(dst, &row, 8);
+    }
+
+    // 0xFF per set bit of the pattern byte (the MSB is the left pixel in the memory order)
+    static const unsigned long long* makeExpandTable()
+    {
+        static unsigned long long table[256];
+        for (int i = 0; i < 256; i++) {
+            unsigned char bytes[8];
+            for (int j = 0; j < 8; j++) bytes[j] = i & (0x80 >> j) ? 0xFF : 0x00;
+            memcpy(&table[i], bytes, 8);
+        }
+        return table;
     }
 
     inline void renderScanlineMode0(int lineNumber)
@@ -300,25 +644,13 @@ class TMS9918A
         int bd = this->ctx.reg[7] & 0b00001111;
         int pixelLine = lineNumber % 8;
         unsigned char* nam = &this->ctx.ram[pn + lineNumber / 8 * 32];
-        int dcur = this->getDisplayAddrFromActiveLineNumber(lineNumber);
-        for (int i = 0; i < 32; i++) {
+        int dcur = TMS9918A_ACTIVE_X; // left border (13px)
+        for (int i = 0; i < 32; i++, dcur += 8) {
             unsigned char ptn = this->ctx.ram[pg + nam[i] * 8 + pixelLine];
             unsigned char c = this->ctx.ram[ct + nam[i] / 8];
-            unsigned char cc[2];
-            cc[1] = (c & 0xF0) >> 4;
-            cc[1] = cc[1] ? cc[1] : bd;
-            cc[0] = c & 0x0F;
-            cc[0] = cc[0] ? cc[0] : bd;
-            this->display[dcur++] = this->palette[cc[(ptn & 0b10000000) >> 7]];
-            this->display[dcur++] = this->palette[cc[(ptn & 0b01000000) >> 6]];
-            this->display[dcur++] = this->palette[cc[(ptn & 0b00100000) >> 5]];
-            this->display[dcur++] = this->palette[cc[(ptn & 0b00010000) >> 4]];
-            this->display[dcur++] = this->palette[cc[(ptn & 0b00001000) >> 3]];
-            this->display[dcur++] = this->palette[cc[(ptn & 0b00000100) >> 2]];
-            this->display[dcur++] = this->palette[cc[(ptn & 0b00000010) >> 1]];
-            this->display[dcur++] = this->palette[cc[ptn & 0b00000001]];
-        }
-        renderSprites(lineNumber);
+            this->decodeRow(&this->lineBuffer[dcur], ptn, c, bd);
+        }
+        this->spriteSignature[lineNumber] = renderSprites(lineNumber, true);
     }
 
     inline void renderScanlineMode2(int lineNumber)
@@ -335,29 +667,23 @@ class TMS9918A
         int bd = this->ctx.reg[7] & 0b00001111;
         int pixelLine = lineNumber % 8;
         unsigned char* nam = &this->ctx.ram[pn + lineNumber / 8 * 32];
-        int dcur = this->getDisplayAddrFromActiveLineNumber(lineNumber);
+        int dcur = TMS9918A_ACTIVE_X; // left border (13px)
         int ci = (lineNumber / 64) * 256;
-        for (int i = 0; i < 32; i++) {
-            unsigned char ptn = this->ctx.ram[pg + ((nam[i] + ci) & pmask) * 8 + pixelLine];
-            unsigned char c = this->ctx.ram[ct + ((nam[i] + ci) & cmask) * 8 + pixelLine];
-            unsigned char cc[2];
-            cc[1] = (c & 0xF0) >> 4;
-            cc[1] = cc[1] ? cc[1] : bd;
-            cc[0] = c & 0x0F;
-            cc[0] = cc[0] ? cc[0] : bd;
-            this->display[dcur++] = this->palette[cc[(ptn & 0b10000000) >> 7]];
-            this->display[dcur++] = this->palette[cc[(ptn & 0b01000000) >> 6]];
-            this->display[dcur++] = this->palette[cc[(ptn & 0b00100000) >> 5]];
-            this->display[dcur++] = this->palette[cc[(ptn & 0b00010000) >> 4]];
-            this->display[dcur++] = this->palette[cc[(ptn & 0b00001000) >> 3]];
-            this->display[dcur++] = this->palette[cc[(ptn & 0b00000100) >> 2]];
-            this->display[dcur++] = this->palette[cc[(ptn & 0b00000010) >> 1]];
-            this->display[dcur++] = this->palette[cc[ptn & 0b00000001]];
-        }
-        renderSprites(lineNumber);
+        for (int i = 0; i < 32; i++, dcur += 8) {
+            int pi = ((nam[i] + ci) & pmask) * 8 + pixelLine;
+            int cj = ((nam[i] + ci) & cmask) * 8 + pixelLine;
+            this->decodeRow(&this->lineBuffer[dcur], this->ctx.ram[pg + pi], this->ctx.ram[ct + cj], bd);
+        }
+        this->spriteSignature[lineNumber] = renderSprites(lineNumber, true);
     }
 
-    inline void renderSprites(int lineNumber)
+    inline unsigned int mixSpriteSignature(unsigned int sig, unsigned int value) { return (sig ^ value) * 0x01000193; }
+
+    /**
+     * render sprites of the scanline (or update the status register only if draw is false)
+     * returns the signature of the sprites that appeared on the scanline
+     */
+    inline unsigned int renderSprites(int lineNumber, bool draw)
     {
         static const unsigned char bit[8] = {
             0b10000000,
@@ -373,11 +699,12 @@ class TMS9918A
         int sa = (this->ctx.reg[5] & 0b01111111) << 7;
         int sg = (this->ctx.reg[6] & 0b00000111) << 11;
         int sn = 0;
+        unsigned int sig = 0x811C9DC5;
         unsigned char dlog[256];
         unsigned char wlog[256];
         memset(dlog, 0, sizeof(dlog));
         memset(wlog, 0, sizeof(wlog));
-        const int dcur = this->getDisplayAddrFromActiveLineNumber(lineNumber);
+        const int dcur = TMS9918A_ACTIVE_X; // left border (13px)
         for (int i = 0; i < 32; i++) {
             int cur = sa + i * 4;
             unsigned char y = this->ctx.ram[cur++];
@@ -403,6 +730,7 @@ class TMS9918A
                         }
                         int pixelLine = lineNumber - y;
                         cur = sg + (ptn & 252) * 8 + pixelLine % 16 / 2 + (pixelLine < 16 ? 0 : 8);
+                        sig = this->mixSpriteSignature(sig, x | col << 8 | this->ctx.ram[cur] << 16 | (unsigned int)this->ctx.ram[cur + 16] << 24);
                         bool overflow = false;
                         for (int j = 0; !overflow && j < 16; j++, x++) {
                             if (wlog[x]) {
@@ -410,7 +738,7 @@ class TMS9918A
                             }
                             if (0 == dlog[x]) {
                                 if (this->ctx.ram[cur] & bit[j / 2]) {
-                                    this->display[dcur + x] = this->palette[col];
+                                    if (draw) this->lineBuffer[dcur + x] = col;
                                     dlog[x] = col;
                                     wlog[x] = 1;
                                 }
@@ -424,7 +752,7 @@ class TMS9918A
                             }
                             if (0 == dlog[x]) {
                                 if (this->ctx.ram[cur] & bit[j / 2]) {
-                                    this->display[dcur + x] = this->palette[col];
+                                    if (draw) this->lineBuffer[dcur + x] = col;
                                     dlog[x] = col;
                                     wlog[x] = 1;
                                 }
@@ -445,6 +773,7 @@ class TMS9918A
                             this->ctx.stat |= i;
                         }
                         cur = sg + ptn * 8 + lineNumber % 8;
+                        sig = this->mixSpriteSignature(sig, x | col << 8 | this->ctx.ram[cur] << 16);
                         bool overflow = false;
                         for (int j = 0; !overflow && j < 16; j++, x++) {
                             if (wlog[x]) {
@@ -452,7 +781,7 @@ class TMS9918A
                             }
                             if (0 == dlog[x]) {
                                 if (this->ctx.ram[cur] & bit[j / 2]) {
-                                    this->display[dcur + x] = this->palette[col];
+                                    if (draw) this->lineBuffer[dcur + x] = col;
                                     dlog[x] = col;
                                     wlog[x] = 1;
                                 }
@@ -476,6 +805,7 @@ class TMS9918A
                         }
                         int pixelLine = lineNumber - y;
                         cur = sg + (ptn & 252) * 8 + pixelLine % 8 + (pixelLine < 8 ? 0 : 8);
+                        sig = this->mixSpriteSignature(sig, x | col << 8 | this->ctx.ram[cur] << 16 | (unsigned int)this->ctx.ram[cur + 16] << 24);
                         bool overflow = false;
                         for (int j = 0; !overflow && j < 8; j++, x++) {
                             if (wlog[x]) {
@@ -483,7 +813,7 @@ class TMS9918A
                             }
                             if (0 == dlog[x]) {
                                 if (this->ctx.ram[cur] & bit[j]) {
-                                    this->display[dcur + x] = this->palette[col];
+                                    if (draw) this->lineBuffer[dcur + x] = col;
                                     dlog[x] = col;
                                     wlog[x] = 1;
                                 }
@@ -497,7 +827,7 @@ class TMS9918A
                             }
                             if (0 == dlog[x]) {
                                 if (this->ctx.ram[cur] & bit[j]) {
-                                    this->display[dcur + x] = this->palette[col];
+                                    if (draw) this->lineBuffer[dcur + x] = col;
                                     dlog[x] = col;
                                     wlog[x] = 1;
                                 }
@@ -518,6 +848,7 @@ class TMS9918A
                             this->ctx.stat |= i;
                         }
                         cur = sg + ptn * 8 + lineNumber % 8;
+                        sig = this->mixSpriteSignature(sig, x | col << 8 | this->ctx.ram[cur] << 16);
                         bool overflow = false;
                         for (int j = 0; !overflow && j < 8; j++, x++) {
                             if (wlog[x]) {
@@ -525,7 +856,7 @@ class TMS9918A
                             }
                             if (0 == dlog[x]) {
                                 if (this->ctx.ram[cur] & bit[j]) {
-                                    this->display[dcur + x] = this->palette[col];
+                                    if (draw) this->lineBuffer[dcur + x] = col;
                                     dlog[x] = col;
                                     wlog[x] = 1;
                                 }
@@ -536,6 +867,7 @@ class TMS9918A
                 }
             }
         }
+        return sig;
     }
 };
 
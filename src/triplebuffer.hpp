@@ -0,0 +1,86 @@
+/**
+ * SUZUKI PLAN - TinyMSX - Lock-free triple buffer
+ * -----------------------------------------------------------------------------
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Yoji Suzuki.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * -----------------------------------------------------------------------------
+ */
+#ifndef INCLUDE_TRIPLEBUFFER_HPP
+#define INCLUDE_TRIPLEBUFFER_HPP
+
+#include <atomic>
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * Single writer (emulator thread) and single reader (presenter thread).
+ * The writer renders into the back buffer and publishes it at the frame end,
+ * the reader acquires the latest published buffer. Both sides never wait.
+ */
+class TripleBuffer
+{
+  private:
+    static const unsigned int FRESH = 0b100; // the middle buffer was published and not acquired yet
+    std::atomic<unsigned int> middle;        // index of the middle buffer | FRESH
+    int back;                                // owned by the writer
+    int front;                               // owned by the reader
+    void* buffers[3];
+    unsigned int tags[3]; // owner defined value that travels with the buffer (e.g. the frame number)
+
+  public:
+    TripleBuffer() { this->setup(NULL, NULL, NULL); }
+
+    void setup(void* buffer1, void* buffer2, void* buffer3)
+    {
+        this->buffers[0] = buffer1;
+        this->buffers[1] = buffer2;
+        this->buffers[2] = buffer3;
+        memset(this->tags, 0, sizeof(this->tags));
+        this->back = 0;
+        this->middle.store(1, std::memory_order_relaxed);
+        this->front = 2;
+    }
+
+    inline bool isEnabled() { return NULL != this->buffers[0]; }
+
+    // writer side
+    inline void* getBack() { return this->buffers[this->back]; }
+    inline unsigned int getBackTag() { return this->tags[this->back]; }
+
+    inline void publish(unsigned int tag)
+    {
+        this->tags[this->back] = tag;
+        this->back = (int)(this->middle.exchange(this->back | FRESH, std::memory_order_acq_rel) & 0b011);
+    }
+
+    // reader side (returns NULL if no frame was published yet)
+    inline const void* acquire(unsigned int* tag = NULL)
+    {
+        if (this->middle.load(std::memory_order_relaxed) & FRESH) {
+            this->front = (int)(this->middle.exchange(this->front, std::memory_order_acq_rel) & 0b011);
+        }
+        if (tag) *tag = this->tags[this->front];
+        return this->tags[this->front] ? this->buffers[this->front] : NULL;
+    }
+};
+
+#endif // INCLUDE_TRIPLEBUFFER_HPP
@@ -37,10 +37,16 @@ class V9938
     void (*detectInterrupt)(void* arg, int ie);
     void (*detectBreak)(void* arg);
 
+    // Scanline dirty tracking: any VRAM, register or palette write invalidates all lines
+    bool dirtyAll;
+    unsigned char lineDirty[212];
+    unsigned char renderedLines[(212 + 7) / 8];
+
   public:
     unsigned short display[256 * 212];
     unsigned short palette[16];
     unsigned short paletteG7[16];
+    unsigned char dirtyLines[(212 + 7) / 8]; // bitmap of the lines updated in the last frame
 
     struct Context {
         int bobo;
@@ -81,6 +87,9 @@ class V9938
         static unsigned int rgb[16] = {0x000000, 0x000000, 0x3EB849, 0x74D07D, 0x5955E0, 0x8076F1, 0xB95E51, 0x65DBEF, 0xDB6559, 0xFF897D, 0xCCC35E, 0xDED087, 0x3AA241, 0xB766B5, 0xCCCCCC, 0xFFFFFF};
         memset(display, 0, sizeof(display));
         memset(&ctx, 0, sizeof(ctx));
+        this->dirtyAll = true;
+        memset(this->renderedLines, 0, sizeof(this->renderedLines));
+        memset(this->dirtyLines, 0xFF, sizeof(this->dirtyLines));
         for (int i = 0; i < 16; i++) {
             this->ctx.pal[i][0] = 0;
             this->ctx.pal[i][1] = 0;
@@ -110,6 +119,8 @@ class V9938
     inline bool isEnabledInterrupt1() { return ctx.reg[0] & 0b00010000 ? true : false; }
     inline bool isEnabledInterrupt2() { return ctx.reg[0] & 0b00100000 ? true : false; }
     inline unsigned short getBackdropColor() { return palette[ctx.reg[7] & 0b00001111]; }
+    inline void invalidateLines() { this->dirtyAll = true; }
+    inline bool isDirtyLine(int y) { return this->dirtyLines[y >> 3] & (1 << (y & 7)) ? true : false; }
     inline bool isEnabledMouse() { return ctx.reg[8] & 0b10000000 ? true : false; }
     inline bool isEnabledLightPen() { return ctx.reg[8] & 0b01000000 ? true : false; }
 
@@ -136,6 +147,8 @@ class V9938
                     break;
                 case 262:
                     this->ctx.countV -= 262;
+                    memcpy(this->dirtyLines, this->renderedLines, sizeof(this->dirtyLines));
+                    memset(this->renderedLines, 0, sizeof(this->renderedLines));
                     this->detectBreak(this->arg);
                     break;
             }
@@ -181,6 +194,7 @@ class V9938
         this->ctx.ram[this->ctx.addr] = this->ctx.readBuffer;
         this->ctx.addr++;
         this->ctx.latch = 0;
+        this->dirtyAll = true;
     }
 
     inline void writePort1(unsigned char value)
@@ -210,6 +224,7 @@ class V9938
         this->ctx.pal[pn][this->ctx.latch++] = value;
         if (2 == this->ctx.latch) {
             updatePaletteCacheFromRegister(pn);
+            this->dirtyAll = true;
             this->ctx.reg[16]++;
             this->ctx.reg[16] &= 0b00001111;
         }
@@ -239,8 +254,20 @@ class V9938
 
     inline void renderScanline(int lineNumber)
     {
+        if (this->dirtyAll) {
+            memset(this->lineDirty, 1, sizeof(this->lineDirty));
+            this->dirtyAll = false;
+        }
         if (0 <= lineNumber && lineNumber < this->getLineNumber()) {
             this->ctx.stat[2] &= 0b10111111; // reset VR flag
+            if (!this->lineDirty[lineNumber]) {
+                // the line is not changed, but the sprites must be evaluated to update the status registers
+                // NOTE: redrawing the same sprites on the unchanged line does not change the pixels
+                if (this->isEnabledScreen()) this->renderScanlineSprites(lineNumber);
+                return;
+            }
+            this->lineDirty[lineNumber] = 0;
+            this->renderedLines[lineNumber >> 3] |= 1 << (lineNumber & 7);
             if (this->isEnabledScreen()) {
                 switch (this->getVideoMode()) {
                     case 0b00000: this->renderScanlineModeG1(lineNumber); break;
@@ -263,6 +290,19 @@ class V9938
         }
     }
 
+    inline void renderScanlineSprites(int lineNumber)
+    {
+        switch (this->getVideoMode()) {
+            case 0b00000: this->renderSpritesMode1(lineNumber); break;
+            case 0b00100: this->renderSpritesMode1(lineNumber); break;
+            case 0b01000: this->renderSpritesMode1(lineNumber); break;
+            case 0b01100: this->renderSpritesMode2(lineNumber); break;
+            case 0b10000: this->renderSpritesMode2(lineNumber); break;
+            case 0b10100: this->renderSpritesMode2(lineNumber); break;
+            case 0b11100: this->renderSpritesMode2(lineNumber); break;
+        }
+    }
+
     inline void updatePaletteCacheFromRegister(int pn)
     {
         unsigned short r = this->ctx.pal[pn][0] & 0b01110000;
@@ -341,6 +381,7 @@ class V9938
 #endif
         bool previousInterrupt = this->isEnabledInterrupt0();
         this->ctx.reg[rn] = value;
+        this->dirtyAll = true;
         if (!previousInterrupt && this->isEnabledInterrupt0() && this->ctx.stat[0] & 0x80) {
             this->detectInterrupt(this->arg, 0);
         }
@@ -0,0 +1,165 @@
+/**
+ * SUZUKI PLAN - TinyMSX - VGM logger
+ * -----------------------------------------------------------------------------
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Yoji Suzuki.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * -----------------------------------------------------------------------------
+ */
+#ifndef INCLUDE_VGMLOGGER_HPP
+#define INCLUDE_VGMLOGGER_HPP
+
+#include <stdio.h>
+#include <string.h>
+
+#define VGM_SAMPLE_RATE 44100
+#define VGM_HEADER_SIZE 0x100
+
+/**
+ * Write the PSG register writes as a VGM (version 1.51) file.
+ * The wait times are derived from the emulated clock (exact: clocks * 44100 / clockRate).
+ */
+class VgmLogger
+{
+  private:
+    FILE* fp;
+    unsigned int clockRate;        // clock of the time arguments
+    unsigned long long base;       // clocks at the start of the current frame
+    unsigned long long totalWaits; // samples already written as the wait commands
+    unsigned int dataSize;
+
+  public:
+    VgmLogger()
+    {
+        this->fp = NULL;
+        this->clockRate = 1;
+    }
+
+    ~VgmLogger() { this->close(); }
+
+    inline bool isOpened() { return NULL != this->fp; }
+
+    /**
+     * - clockRate: clock of the time arguments (the CPU clock)
+     * - snClock: SN76489 clock (0: not used)
+     * - ayClock: AY-3-8910 clock (0: not used)
+     */
+    bool open(const char* path, unsigned int clockRate, unsigned int snClock, unsigned int ayClock)
+    {
+        this->close();
+        this->fp = fopen(path, "wb");
+        if (!this->fp) return false;
+        this->clockRate = clockRate ? clockRate : 1;
+        this->base = 0;
+        this->totalWaits = 0;
+        this->dataSize = 0;
+        unsigned char header[VGM_HEADER_SIZE];
+        memset(header, 0, sizeof(header));
+        memcpy(header, "Vgm ", 4);
+        setLE32(&header[0x08], 0x151);
+        setLE32(&header[0x0C], snClock);
+        if (snClock) {
+            header[0x28] = 0x09; // SN76489 feedback pattern
+            header[0x2A] = 16;   // SN76489 shift register width
+        }
+        setLE32(&header[0x34], VGM_HEADER_SIZE - 0x34);
+        setLE32(&header[0x74], ayClock);
+        if (VGM_HEADER_SIZE != fwrite(header, 1, VGM_HEADER_SIZE, this->fp)) {
+            this->close();
+            return false;
+        }
+        return true;
+    }
+
+    // write the end mark and the sizes to the header
+    void close()
+    {
+        if (!this->fp) return;
+        this->put(0x66, 0, 0, 1);
+        unsigned char buf[4];
+        setLE32(buf, VGM_HEADER_SIZE + this->dataSize - 0x04);
+        fseek(this->fp, 0x04, SEEK_SET);
+        fwrite(buf, 1, 4, this->fp);
+        setLE32(buf, (unsigned int)this->totalWaits);
+        fseek(this->fp, 0x18, SEEK_SET);
+        fwrite(buf, 1, 4, this->fp);
+        fclose(this->fp);
+        this->fp = NULL;
+    }
+
+    // time: clocks from the start of the current frame
+    inline void writeSN76489(unsigned int time, unsigned char value)
+    {
+        if (!this->fp) return;
+        this->wait(time);
+        this->put(0x50, value, 0, 2);
+    }
+
+    inline void writeAY8910(unsigned int time, unsigned char reg, unsigned char value)
+    {
+        if (!this->fp) return;
+        this->wait(time);
+        this->put(0xA0, reg, value, 3);
+    }
+
+    inline void endFrame(unsigned int time)
+    {
+        if (!this->fp) return;
+        this->wait(time);
+        this->base += time;
+    }
+
+  private:
+    static inline void setLE32(unsigned char* ptr, unsigned int value)
+    {
+        ptr[0] = value & 0xFF;
+        ptr[1] = (value >> 8) & 0xFF;
+        ptr[2] = (value >> 16) & 0xFF;
+        ptr[3] = (value >> 24) & 0xFF;
+    }
+
+    inline void put(unsigned char c, unsigned char v1, unsigned char v2, int size)
+    {
+        unsigned char buf[3] = {c, v1, v2};
+        this->dataSize += (unsigned int)fwrite(buf, 1, size, this->fp);
+    }
+
+    inline void wait(unsigned int time)
+    {
+        unsigned long long samples = (this->base + time) * VGM_SAMPLE_RATE / this->clockRate;
+        while (this->totalWaits < samples) {
+            unsigned long long n = samples - this->totalWaits;
+            if (0xFFFF < n) n = 0xFFFF;
+            if (n <= 16) {
+                this->put(0x70 + (unsigned char)(n - 1), 0, 0, 1);
+            } else if (735 == n) {
+                this->put(0x62, 0, 0, 1);
+            } else if (882 == n) {
+                this->put(0x63, 0, 0, 1);
+            } else {
+                this->put(0x61, n & 0xFF, (n >> 8) & 0xFF, 3);
+            }
+            this->totalWaits += n;
+        }
+    }
+};
+
+#endif // INCLUDE_VGMLOGGER_HPP
@@ -0,0 +1,223 @@
+/**
+ * SUZUKI PLAN - TinyMSX - VGM player
+ * -----------------------------------------------------------------------------
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Yoji Suzuki.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * -----------------------------------------------------------------------------
+ */
+#ifndef INCLUDE_VGMPLAYER_HPP
+#define INCLUDE_VGMPLAYER_HPP
+
+#include <string.h>
+#include "blipbuf.hpp"
+#include "sn76489.hpp"
+#include "ay8910.hpp"
+#include "vgmlogger.hpp"
+
+#define VGM_PLAYER_CHUNK 512 // maximum VGM samples per rendering step (must fit in the blip buffer at 192kHz)
+
+/**
+ * Play the SN76489 and AY-3-8910 commands of a VGM file with the chip classes (no CPU and VDP).
+ * The chips run with the MSX / SG-1000 CPU clock (3579545Hz) time base,
+ * and the VGM waits (44100Hz) are converted to the clocks exactly.
+ * The other chips' commands are skipped.
+ */
+class VgmPlayer
+{
+  private:
+    const unsigned char* data; // caller memory (must be kept while playing)
+    size_t size;
+    size_t position;
+    size_t start;
+    unsigned int clockRate;
+    unsigned int clockRemainder; // sub-clock position of the chunk start (unit: 1 / 44100 clock)
+    unsigned int waitRemain;     // samples of the current wait command
+    bool useSN;
+    bool useAY;
+    bool ended;
+    BlipBuffer blip;
+
+  public:
+    SN76489 sn76489;
+    AY8910 ay8910;
+
+    VgmPlayer()
+    {
+        this->data = NULL;
+        this->size = 0;
+        this->clockRate = 3579545;
+        this->blip.setRates(this->clockRate, VGM_SAMPLE_RATE);
+        this->rewind();
+    }
+
+    bool load(const void* data, size_t size)
+    {
+        const unsigned char* d = (const unsigned char*)data;
+        if (!d || size < 0x40 || 0 != memcmp(d, "Vgm ", 4)) return false;
+        unsigned int version = getLE32(&d[0x08]);
+        size_t start = 0x40;
+        if (0x150 <= version && getLE32(&d[0x34])) start = 0x34 + getLE32(&d[0x34]);
+        if (size <= start) return false;
+        this->data = d;
+        this->size = size;
+        this->start = start;
+        this->useSN = 0 != getLE32(&d[0x0C]);
+        this->useAY = 0x151 <= version && 0x78 <= start && 0 != getLE32(&d[0x74]);
+        this->rewind();
+        return true;
+    }
+
+    // total length (samples at 44100Hz)
+    inline unsigned int getTotalSamples() { return this->data ? getLE32(&this->data[0x18]) : 0; }
+    inline bool isEnded() { return this->ended; }
+
+    void setSampleRate(unsigned int sampleRate)
+    {
+        this->blip.setRates(this->clockRate, sampleRate);
+    }
+
+    void rewind()
+    {
+        this->position = this->data ? this->start : 0;
+        this->clockRemainder = 0;
+        this->waitRemain = 0;
+        this->ended = NULL == this->data;
+        this->sn76489.reset();
+        this->ay8910.reset(27);
+        this->blip.clear();
+    }
+
+    /**
+     * Render the int16 samples (returns the number of the rendered samples, less than count at the end)
+     */
+    int render(short* buffer, int count, bool stereo)
+    {
+        int result = 0;
+        while (result < count) {
+            if (!this->blip.getAvailable()) {
+                if (this->ended) break;
+                this->step(VGM_PLAYER_CHUNK);
+            }
+            int n = this->blip.read(buffer, count - result, stereo);
+            buffer += stereo ? n * 2 : n;
+            result += n;
+        }
+        return result;
+    }
+
+  private:
+    static inline unsigned int getLE32(const unsigned char* ptr)
+    {
+        return ptr[0] | ptr[1] << 8 | ptr[2] << 16 | (unsigned int)ptr[3] << 24;
+    }
+
+    // clocks of the samples from the chunk start
+    inline unsigned int toClocks(unsigned int samples)
+    {
+        return (unsigned int)(((unsigned long long)samples * this->clockRate + this->clockRemainder) / VGM_SAMPLE_RATE);
+    }
+
+    // execute the commands of a chunk (up to the specified samples of the waits)
+    void step(unsigned int samples)
+    {
+        unsigned int elapsed = 0;
+        while (elapsed < samples && !this->ended) {
+            if (this->waitRemain) {
+                unsigned int n = samples - elapsed < this->waitRemain ? samples - elapsed : this->waitRemain;
+                elapsed += n;
+                this->waitRemain -= n;
+                continue;
+            }
+            this->execute(this->toClocks(elapsed));
+        }
+        unsigned int time = this->toClocks(elapsed);
+        if (this->useSN) this->sn76489.endFrame(&this->blip, time);
+        if (this->useAY) this->ay8910.endFrame(&this->blip, time);
+        this->blip.endFrame(time);
+        this->clockRemainder = (unsigned int)(((unsigned long long)elapsed * this->clockRate + this->clockRemainder) % VGM_SAMPLE_RATE);
+    }
+
+    // execute a command at the time (clocks from the chunk start)
+    inline void execute(unsigned int time)
+    {
+        if (this->size <= this->position) {
+            this->ended = true;
+            return;
+        }
+        const unsigned char* d = &this->data[this->position];
+        size_t rest = this->size - this->position;
+        unsigned char cmd = d[0];
+        size_t length;
+        if (0x70 <= cmd && cmd <= 0x8F) {
+            this->waitRemain = (cmd & 0x0F) + (cmd < 0x80 ? 1 : 0);
+            length = 1;
+        } else if ((0x30 <= cmd && cmd <= 0x3F) || 0x4F == cmd || 0x50 == cmd) {
+            length = 2;
+        } else if ((0x40 <= cmd && cmd <= 0x5F) || (0xA0 <= cmd && cmd <= 0xBF)) {
+            length = 3;
+        } else if (0xC0 <= cmd && cmd <= 0xDF) {
+            length = 4;
+        } else if (0xE0 <= cmd) {
+            length = 5;
+        } else {
+            switch (cmd) {
+                case 0x61: length = 3; break;
+                case 0x62:
+                case 0x63: length = 1; break;
+                case 0x67: length = 7 <= rest ? 7 + getLE32(&d[3]) : rest; break;
+                case 0x90:
+                case 0x91:
+                case 0x95: length = 5; break;
+                case 0x92: length = 6; break;
+                case 0x93: length = 11; break;
+                case 0x94: length = 2; break;
+                default: length = rest; // 0x66 (end) or unknown
+            }
+        }
+        if (rest < length) {
+            this->ended = true;
+            return;
+        }
+        switch (cmd) {
+            case 0x50:
+                if (this->useSN) {
+                    this->sn76489.run(&this->blip, time);
+                    this->sn76489.write(d[1]);
+                }
+                break;
+            case 0xA0:
+                if (this->useAY && d[1] < 14) {
+                    this->ay8910.run(&this->blip, time);
+                    this->ay8910.latch(d[1]);
+                    this->ay8910.write(d[2]);
+                }
+                break;
+            case 0x61: this->waitRemain = d[1] | d[2] << 8; break;
+            case 0x62: this->waitRemain = 735; break;
+            case 0x63: this->waitRemain = 882; break;
+            case 0x66: this->ended = true; break;
+        }
+        this->position += length;
+    }
+};
+
+#endif // INCLUDE_VGMPLAYER_HPP
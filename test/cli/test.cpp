@@ -19,7 +19,7 @@ struct BitmapHeader {
     unsigned int cir;
 };
 
-void saveBitmap(const char* filename, unsigned short* display, int width, int height)
+void saveBitmap(const char* filename, unsigned int* display, int width, int height)
 {
     struct BitmapHeader hed;
     memset(&hed, 0, sizeof(hed));
@@ -41,19 +41,7 @@ void saveBitmap(const char* filename, unsigned short* display, int width, int he
     for (int y = 0; y < height; y++) {
         int posY = height - y - 1;
         unsigned int line[width];
-        for (int x = 0; x < width; x++) {
-            unsigned short p = display[posY * width + x];
-            unsigned char r = (p & 0b0111110000000000) >> 7;
-            unsigned char g = (p & 0b0000001111100000) >> 2;
-            unsigned char b = (p & 0b0000000000011111) << 3;
-            line[x] = 0xFF;
-            line[x] <<= 8;
-            line[x] |= r;
-            line[x] <<= 8;
-            line[x] |= g;
-            line[x] <<= 8;
-            line[x] |= b;
-        }
+        memcpy(line, &display[posY * width], sizeof(line));
         fwrite(line, 1, sizeof(line), fp);
     }
     fclose(fp);
@@ -112,7 +100,7 @@ int main(int argc, char* argv[])
     fseek(fp, 0, SEEK_SET);
     fread(rom, 1, romSize, fp);
     fclose(fp);
-    TinyMSX msx(type, rom, romSize, 0x8000, TINYMSX_COLOR_MODE_RGB555);
+    TinyMSX msx(type, rom, romSize, 0x8000, TINYMSX_COLOR_MODE_INDEXED8);
     if (msx.isMSX1Family()) {
         if (!msx.loadBiosFromFile("../../bios/cbios_main_msx1.rom")) {
             puts("load BIOS error");
@@ -125,8 +113,8 @@ int main(int argc, char* argv[])
         int pn = msx->cpu->reg.PC / 0x4000;
         printf("%08d %3d (VI:%02X) (%d-%d %d-%d, %d-%d, %d-%d) %s\n",
                ++count,
-               msx->tms9918.ctx.countV,
-               msx->tms9918.getVideoMode(),
+               msx->tms9918->ctx.countV,
+               msx->tms9918->getVideoMode(),
                msx->slot.primaryNumber(0),
                msx->slot.secondaryNumber(0),
                msx->slot.primaryNumber(1),
@@ -148,44 +136,46 @@ int main(int argc, char* argv[])
         msx.tick(0xFF, 0xFF);
     }
     if (bmp) {
-        saveBitmap(bmp, msx.getDisplayBuffer(), 256, 192);
+        static unsigned int display[TMS9918A_SCREEN_WIDTH * TMS9918A_SCREEN_HEIGHT];
+        msx.convertDisplayBuffer(display, TINYMSX_COLOR_MODE_ARGB8888);
+        saveBitmap(bmp, display, TMS9918A_SCREEN_WIDTH, TMS9918A_SCREEN_HEIGHT);
     }
 
     {
         FILE* fp = fopen("tms9918.dmp", "wb");
         if (fp) {
-            switch (msx.tms9918.getVideoMode()) {
+            switch (msx.tms9918->getVideoMode()) {
                 case 2: {
-                    unsigned short pn = ((int)(msx.tms9918.ctx.reg[2] & 0b00001111)) << 10;
-                    unsigned short ct = ((int)(msx.tms9918.ctx.reg[3] & 0b10000000)) << 6;
-                    unsigned short pg = ((int)(msx.tms9918.ctx.reg[4] & 0b00000100)) << 11;
-                    unsigned short sa = ((int)(msx.tms9918.ctx.reg[5] & 0b01111111)) << 7;
-                    unsigned short sg = ((int)(msx.tms9918.ctx.reg[6] & 0b00000111)) << 11;
+                    unsigned short pn = ((int)(msx.tms9918->ctx.reg[2] & 0b00001111)) << 10;
+                    unsigned short ct = ((int)(msx.tms9918->ctx.reg[3] & 0b10000000)) << 6;
+                    unsigned short pg = ((int)(msx.tms9918->ctx.reg[4] & 0b00000100)) << 11;
+                    unsigned short sa = ((int)(msx.tms9918->ctx.reg[5] & 0b01111111)) << 7;
+                    unsigned short sg = ((int)(msx.tms9918->ctx.reg[6] & 0b00000111)) << 11;
                     fprintf(fp, "Video MODE: $%02X\n", 2);
-                    fprintf(fp, "TC: $%X, BD: $%X\n", msx.tms9918.ctx.reg[7] / 16, msx.tms9918.ctx.reg[7] % 16);
+                    fprintf(fp, "TC: $%X, BD: $%X\n", msx.tms9918->ctx.reg[7] / 16, msx.tms9918->ctx.reg[7] % 16);
                     fprintf(fp, "PN: $%04X  CT: $%04X  PG: $%04X  SA: $%04X  SG: $%04X\n", pn, ct, pg, sa, sg);
-                    print_dump(fp, "Pattern Name Table", msx.tms9918.ctx.ram, pn, 768);
-                    print_dump(fp, "Color Table", msx.tms9918.ctx.ram, ct, 6144);
-                    print_dump(fp, "Character Pattern Generator", msx.tms9918.ctx.ram, pg, 6144);
-                    print_dump(fp, "Sprite Attribute", msx.tms9918.ctx.ram, sa, 128);
-                    print_dump(fp, "Sprite Pattern Generator", msx.tms9918.ctx.ram, sg, 2048);
+                    print_dump(fp, "Pattern Name Table", msx.tms9918->ctx.ram, pn, 768);
+                    print_dump(fp, "Color Table", msx.tms9918->ctx.ram, ct, 6144);
+                    print_dump(fp, "Character Pattern Generator", msx.tms9918->ctx.ram, pg, 6144);
+                    print_dump(fp, "Sprite Attribute", msx.tms9918->ctx.ram, sa, 128);
+                    print_dump(fp, "Sprite Pattern Generator", msx.tms9918->ctx.ram, sg, 2048);
                     break;
                 }
                 default: {
                     // dump as Mode 0
-                    unsigned short pn = ((int)(msx.tms9918.ctx.reg[2] & 0b00001111)) << 10;
-                    unsigned short ct = ((int)msx.tms9918.ctx.reg[3]) << 6;
-                    unsigned short pg = ((int)(msx.tms9918.ctx.reg[4] & 0b00000111)) << 11;
-                    unsigned short sa = ((int)(msx.tms9918.ctx.reg[5] & 0b01111111)) << 7;
-                    unsigned short sg = ((int)(msx.tms9918.ctx.reg[6] & 0b00000111)) << 11;
-                    fprintf(fp, "Video MODE: $%02X\n", msx.tms9918.getVideoMode());
-                    fprintf(fp, "TC: $%X, BD: $%X\n", msx.tms9918.ctx.reg[7] / 16, msx.tms9918.ctx.reg[7] % 16);
+                    unsigned short pn = ((int)(msx.tms9918->ctx.reg[2] & 0b00001111)) << 10;
+                    unsigned short ct = ((int)msx.tms9918->ctx.reg[3]) << 6;
+                    unsigned short pg = ((int)(msx.tms9918->ctx.reg[4] & 0b00000111)) << 11;
+                    unsigned short sa = ((int)(msx.tms9918->ctx.reg[5] & 0b01111111)) << 7;
+                    unsigned short sg = ((int)(msx.tms9918->ctx.reg[6] & 0b00000111)) << 11;
+                    fprintf(fp, "Video MODE: $%02X\n", msx.tms9918->getVideoMode());
+                    fprintf(fp, "TC: $%X, BD: $%X\n", msx.tms9918->ctx.reg[7] / 16, msx.tms9918->ctx.reg[7] % 16);
                     fprintf(fp, "PN: $%04X  CT: $%04X  PG: $%04X  SA: $%04X  SG: $%04X\n", pn, ct, pg, sa, sg);
-                    print_dump(fp, "Pattern Name Table", msx.tms9918.ctx.ram, pn, 768);
-                    print_dump(fp, "Color Table", msx.tms9918.ctx.ram, ct, 32);
-                    print_dump(fp, "Character Pattern Generator", msx.tms9918.ctx.ram, pg, 2048);
-                    print_dump(fp, "Sprite Attribute", msx.tms9918.ctx.ram, sa, 128);
-                    print_dump(fp, "Sprite Pattern Generator", msx.tms9918.ctx.ram, sg, 2048);
+                    print_dump(fp, "Pattern Name Table", msx.tms9918->ctx.ram, pn, 768);
+                    print_dump(fp, "Color Table", msx.tms9918->ctx.ram, ct, 32);
+                    print_dump(fp, "Character Pattern Generator", msx.tms9918->ctx.ram, pg, 2048);
+                    print_dump(fp, "Sprite Attribute", msx.tms9918->ctx.ram, sa, 128);
+                    print_dump(fp, "Sprite Pattern Generator", msx.tms9918->ctx.ram, sg, 2048);
                 }
             }
             fclose(fp);
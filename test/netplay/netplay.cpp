@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../../src/rollback.hpp"
+
+#define PACKET_MAX 4096
+#define PACKET_INPUT 0
+#define PACKET_HASH 1
+#define HASH_INTERVAL 10 // frames per state hash packet
+#define INPUT_DELAY 2
+#define WINDOW 15
+
+void usage() { puts("usage: netplay {sg1000 | msx} rom-file [frames [latency [jitter [seed]]]]"); }
+
+// deterministic random numbers (xorshift32)
+static unsigned int nextRandom(unsigned int* seed)
+{
+    unsigned int x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seed = x;
+    return x;
+}
+
+// input of a player at a frame: changes every 4 ~ 19 frames
+static unsigned char getPad(int player, unsigned int frame)
+{
+    unsigned int seed = (frame / (4 + player * 15) + 1) * 2654435761U + player;
+    nextRandom(&seed);
+    return nextRandom(&seed) & 0x3F;
+}
+
+struct Packet {
+    unsigned int deliver; // host frame to be received
+    int type;
+    unsigned int frame;
+    unsigned long long value;
+};
+
+// one direction of the in-process network (the jitter also changes the order of the packets)
+class Loopback
+{
+  private:
+    Packet packets[PACKET_MAX];
+    int count;
+    int latency;
+    int jitter;
+    unsigned int seed;
+
+  public:
+    Loopback(int latency, int jitter, unsigned int seed)
+    {
+        this->count = 0;
+        this->latency = latency;
+        this->jitter = jitter;
+        this->seed = seed ? seed : 1;
+    }
+
+    bool send(unsigned int now, int type, unsigned int frame, unsigned long long value)
+    {
+        if (PACKET_MAX <= this->count) return false;
+        Packet* p = &this->packets[this->count++];
+        p->deliver = now + this->latency + (this->jitter ? nextRandom(&this->seed) % (this->jitter + 1) : 0);
+        p->type = type;
+        p->frame = frame;
+        p->value = value;
+        return true;
+    }
+
+    bool receive(unsigned int now, Packet* packet)
+    {
+        for (int i = 0; i < this->count; i++) {
+            if (this->packets[i].deliver <= now) {
+                *packet = this->packets[i];
+                this->packets[i] = this->packets[--this->count];
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+struct Peer {
+    TinyMSX* msx;
+    RollbackSession session;
+    Loopback* in;
+    Loopback* out;
+    int player;
+    unsigned int inputs;    // local inputs added
+    unsigned int hashFrame; // next frame to send the hash
+    unsigned int stalls;
+    unsigned int verified; // hashes equal to the reference
+    unsigned int mismatches;
+};
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3) {
+        usage();
+        return 1;
+    }
+    int type;
+    if (0 == strcmp(argv[1], "sg1000")) {
+        type = TINYMSX_TYPE_SG1000;
+    } else if (0 == strcmp(argv[1], "msx")) {
+        type = TINYMSX_TYPE_MSX1;
+    } else {
+        usage();
+        return 1;
+    }
+    unsigned int frames = argc < 4 ? 600 : (unsigned int)atoi(argv[3]);
+    int latency = argc < 5 ? 4 : atoi(argv[4]);
+    int jitter = argc < 6 ? 3 : atoi(argv[5]);
+    unsigned int seed = argc < 7 ? 1 : (unsigned int)atoi(argv[6]);
+    FILE* fp = fopen(argv[2], "rb");
+    if (!fp) {
+        puts("File not found");
+        return 1;
+    }
+    fseek(fp, 0, SEEK_END);
+    size_t romSize = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    void* rom = malloc(romSize);
+    if (!rom || romSize != fread(rom, 1, romSize, fp)) {
+        puts("Read error");
+        fclose(fp);
+        return 1;
+    }
+    fclose(fp);
+    TinyMSX* machines[3];
+    for (int i = 0; i < 3; i++) {
+        machines[i] = new TinyMSX(type, rom, romSize, 0x8000, TINYMSX_COLOR_MODE_RGB555);
+        if (machines[i]->isMSX1Family() && !machines[i]->loadBiosFromFile("../../bios/cbios_main_msx1.rom")) {
+            puts("load BIOS error");
+            return 1;
+        }
+        machines[i]->reset();
+    }
+
+    // reference: the same inputs without the network
+    unsigned long long* reference = (unsigned long long*)malloc(sizeof(unsigned long long) * (frames + 1));
+    for (unsigned int i = 0; i <= frames; i++) {
+        reference[i] = machines[2]->stateHash();
+        unsigned char pad1 = i < INPUT_DELAY ? 0 : getPad(0, i);
+        unsigned char pad2 = i < INPUT_DELAY ? 0 : getPad(1, i);
+        machines[2]->tick(pad1, pad2);
+    }
+
+    Loopback link1(latency, jitter, seed);
+    Loopback link2(latency, jitter, seed * 31 + 7);
+    Peer peers[2];
+    for (int i = 0; i < 2; i++) {
+        Peer* p = &peers[i];
+        p->msx = machines[i];
+        p->player = i;
+        p->in = i ? &link1 : &link2;
+        p->out = i ? &link2 : &link1;
+        p->inputs = 0;
+        p->hashFrame = 0;
+        p->stalls = 0;
+        p->verified = 0;
+        p->mismatches = 0;
+        if (!p->session.setup(p->msx, i, INPUT_DELAY, WINDOW)) {
+            puts("setup error");
+            return 1;
+        }
+    }
+    clock_t start = clock();
+    unsigned int now;
+    for (now = 0; peers[0].session.getCurrentFrame() < frames || peers[1].session.getCurrentFrame() < frames; now++) {
+        for (int i = 0; i < 2; i++) {
+            Peer* p = &peers[i];
+            Packet packet;
+            while (p->in->receive(now, &packet)) {
+                if (PACKET_INPUT == packet.type) {
+                    p->session.addRemoteInput(packet.frame, (unsigned char)packet.value);
+                } else {
+                    p->session.addRemoteHash(packet.frame, packet.value);
+                }
+            }
+            if (frames <= p->session.getCurrentFrame()) continue;
+            // a local input per executed frame
+            if (p->inputs <= p->session.getCurrentFrame()) {
+                unsigned int frame;
+                if (p->session.addLocalInput(getPad(i, INPUT_DELAY + p->inputs), &frame)) {
+                    p->out->send(now, PACKET_INPUT, frame, getPad(i, frame));
+                    p->inputs++;
+                }
+            }
+            if (!p->session.advance()) p->stalls++;
+            unsigned long long hash;
+            while (p->session.getStateHash(p->hashFrame, &hash)) {
+                if (hash == reference[p->hashFrame]) {
+                    p->verified++;
+                } else {
+                    p->mismatches++;
+                }
+                if (0 == p->hashFrame % HASH_INTERVAL) p->out->send(now, PACKET_HASH, p->hashFrame, hash);
+                p->hashFrame++;
+            }
+        }
+    }
+    double sec = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("latency %d frames, jitter 0 ~ %d frames, input delay %d frames, window %d frames\n", latency, jitter, INPUT_DELAY, WINDOW);
+    bool ok = true;
+    for (int i = 0; i < 2; i++) {
+        Peer* p = &peers[i];
+        printf("player %d: %u frames in %u host frames, %u rollbacks (%u frames resimulated), %u stalls, ", i + 1, p->session.getCurrentFrame(), now, p->session.getRollbackCount(), p->session.getResimulatedFrames(), p->stalls);
+        printf("%u hashes verified, %u mismatches, ", p->verified, p->mismatches);
+        if (p->session.isDesynced()) {
+            printf("desync at frame %u\n", p->session.getDesyncFrame());
+        } else {
+            printf("no desync\n");
+        }
+        ok = ok && !p->mismatches && !p->session.isDesynced();
+    }
+    printf("%s (%.3f sec)\n", ok ? "OK" : "NG", sec);
+    for (int i = 0; i < 3; i++) delete machines[i];
+    free(reference);
+    free(rom);
+    return ok ? 0 : 1;
+}
@@ -10,33 +10,30 @@
 #include "tinymsx_def.h"
 #include "tinymsx_gw.h"
 #include "vgsspu_al.h"
-#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 char emu_msx_bios[0x8000];
-unsigned short emu_vram[VRAM_WIDTH * VRAM_HEIGHT];
+static unsigned short emu_frames[3][VRAM_WIDTH * VRAM_HEIGHT];
+static unsigned short emu_blank[VRAM_WIDTH * VRAM_HEIGHT];
 unsigned char emu_key = 0;
 static void* spu;
-pthread_mutex_t sound_locker;
-static short sound_buffer[65536 * 2];
-static volatile unsigned short sound_cursor;
 
 static int emu_initialized = 0;
 static void* emu_msx = NULL;
+static void* emu_state = NULL;
+static size_t emu_stateSize = 0;
 
 static void sound_callback(void* buffer, size_t size)
 {
-    while (sound_cursor < size / 2) usleep(100);
-    pthread_mutex_lock(&sound_locker);
-    memcpy(buffer, sound_buffer, size);
-    if (size <= sound_cursor)
-        sound_cursor -= size;
-    else
-        sound_cursor = 0;
-    pthread_mutex_unlock(&sound_locker);
+    // 44100Hz/16bit/2ch (4 bytes per frame): the missing frames are filled with silence
+    if (emu_msx) {
+        tinymsx_read_sound(emu_msx, buffer, (unsigned int)(size / 4));
+    } else {
+        memset(buffer, 0, size);
+    }
 }
 
 static int getTypeOfRom(char* rom, size_t romSize)
@@ -66,10 +63,11 @@ void emu_init(const void* rom, size_t romSize)
     printf("load rom (size: %lu)\n", romSize);
     emu_msx = tinymsx_create(getTypeOfRom((char*)rom, romSize), rom, romSize, 0x4000, TINYMSX_COLOR_MODE_RGB555);
     tinymsx_load_bios_msx1_main(emu_msx, emu_msx_bios, sizeof(emu_msx_bios));
+    tinymsx_set_triple_buffer(emu_msx, emu_frames[0], emu_frames[1], emu_frames[2], VRAM_WIDTH * 2, TINYMSX_COLOR_MODE_RGB555, 1);
+    tinymsx_set_sound_ring(emu_msx, 23520 / 4 * 2);
     tinymsx_reset(emu_msx);
     tinymsx_setup_special_key1(emu_msx, '1', 0);
     tinymsx_setup_special_key2(emu_msx, ' ', 0);
-    pthread_mutex_init(&sound_locker, NULL);
     spu = vgsspu_start2(44100, 16, 2, 23520, sound_callback);
     emu_initialized = 1;
 }
@@ -81,12 +79,19 @@ void emu_reload(const void* rom, size_t romSize)
         return;
     }
     puts("emu_reload");
-    if (emu_msx) {
-        tinymsx_destroy(emu_msx);
+    void* msx = tinymsx_create(getTypeOfRom((char*)rom, romSize), rom, romSize, 0x4000, TINYMSX_COLOR_MODE_RGB555);
+    tinymsx_load_bios_msx1_main(msx, emu_msx_bios, sizeof(emu_msx_bios));
+    tinymsx_set_triple_buffer(msx, emu_frames[0], emu_frames[1], emu_frames[2], VRAM_WIDTH * 2, TINYMSX_COLOR_MODE_RGB555, 1);
+    tinymsx_set_sound_ring(msx, 23520 / 4 * 2);
+    tinymsx_reset(msx);
+    // the sound thread reads emu_msx without a lock: stop it (vgsspu_end joins the thread) before destroying the old instance
+    if (spu) vgsspu_end(spu);
+    void* old = emu_msx;
+    emu_msx = msx;
+    if (old) {
+        tinymsx_destroy(old);
     }
-    emu_msx = tinymsx_create(getTypeOfRom((char*)rom, romSize), rom, romSize, 0x4000, TINYMSX_COLOR_MODE_RGB555);
-    tinymsx_load_bios_msx1_main(emu_msx, emu_msx_bios, sizeof(emu_msx_bios));
-    tinymsx_reset(emu_msx);
+    spu = vgsspu_start2(44100, 16, 2, 23520, sound_callback);
 }
 
 void emu_reset()
@@ -98,22 +103,18 @@ void emu_reset()
  * 画面の更新間隔（1秒間で60回）毎にこの関数がコールバックされる
  * この中で以下の処理を実行する想定:
  * 1. エミュレータのCPU処理を1フレーム分実行
- * 2. エミュレータの画面バッファの内容をvramへコピー
+ * 2. 描画スレッドは emu_acquireVram で最新フレームを取得 (トリプルバッファなのでコピー不要)
  */
 void emu_vsync()
 {
     if (!emu_initialized || !emu_msx) return;
     tinymsx_tick(emu_msx, emu_key, 0);
-    const void* ptr = tinymsx_display(emu_msx);
-    memcpy(emu_vram, ptr, sizeof(emu_vram));
-    size_t pcmSize;
-    void* pcm = tinymsx_sound(emu_msx, &pcmSize);
-    pthread_mutex_lock(&sound_locker);
-    if (pcmSize + sound_cursor < sizeof(sound_buffer)) {
-        memcpy(&sound_buffer[sound_cursor], pcm, pcmSize);
-        sound_cursor += pcmSize / 2;
-    }
-    pthread_mutex_unlock(&sound_locker);
+}
+
+const unsigned short* emu_acquireVram()
+{
+    const void* ptr = emu_msx ? tinymsx_acquire_frame(emu_msx, NULL) : NULL;
+    return ptr ? (const unsigned short*)ptr : emu_blank;
 }
 
 unsigned int emu_getScore()
@@ -136,9 +137,17 @@ void emu_destroy()
 {
     puts("emu_destroy");
     if (!emu_initialized) return;
+    if (spu) vgsspu_end(spu);
+    spu = NULL;
     if (emu_msx) {
-        tinymsx_destroy(emu_msx);
+        void* msx = emu_msx;
         emu_msx = NULL;
+        tinymsx_destroy(msx);
+    }
+    if (emu_state) {
+        free(emu_state);
+        emu_state = NULL;
+        emu_stateSize = 0;
     }
     emu_initialized = 0;
 }
@@ -146,13 +155,21 @@ void emu_destroy()
 const void* emu_saveState(size_t* size)
 {
     if (!emu_initialized || !emu_msx) return NULL;
-    return tinymsx_save(emu_msx, size);
+    size_t stateSize = tinymsx_state_size(emu_msx);
+    if (emu_stateSize < stateSize) {
+        void* state = realloc(emu_state, stateSize);
+        if (!state) return NULL;
+        emu_state = state;
+        emu_stateSize = stateSize;
+    }
+    *size = tinymsx_save(emu_msx, emu_state, emu_stateSize);
+    return emu_state;
 }
 
 void emu_loadState(const void* state, size_t size)
 {
     if (!emu_initialized || !emu_msx) return;
-    tinymsx_load(emu_msx, state, size);
+    if (!tinymsx_load(emu_msx, state, size)) puts("invalid state data");
 }
 
 void emu_printDump()
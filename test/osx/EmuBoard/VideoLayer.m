@@ -43,6 +43,7 @@ static volatile int bno;
 {
     bno = 1 - bno;
     unsigned short* buf = imgbuf[1 - bno];
+    const unsigned short* emu_vram = emu_acquireVram();
     int i = 0;
     for (int y = 0; y < VRAM_HEIGHT; y++) {
         int ptr = y * VRAM_WIDTH;
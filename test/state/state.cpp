@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../src/tinymsx.h"
+
+void usage() { puts("usage: state {sg1000 | msx} rom-file"); }
+
+static unsigned char* save(TinyMSX* msx, bool delta, size_t* size)
+{
+    size_t capacity = delta ? msx->getDeltaStateSize() : msx->getStateSize();
+    unsigned char* buffer = (unsigned char*)malloc(capacity);
+    if (!buffer) exit(1);
+    *size = delta ? msx->saveDeltaState(buffer, capacity) : msx->saveState(buffer, capacity);
+    return buffer;
+}
+
+// full state -> ticks -> delta state -> ticks, then load the chain and check the state hash of the delta
+static bool testDeltaChain(TinyMSX* msx, int runAhead, bool compression)
+{
+    msx->reset();
+    msx->setRunAhead(runAhead);
+    msx->setStateCompression(compression);
+    for (int i = 0; i < 30; i++) msx->tick(0, 0);
+    size_t baseSize;
+    unsigned char* base = save(msx, false, &baseSize);
+    for (int i = 0; i < 30; i++) msx->tick(i & 0x10 ? 0x01 : 0, 0);
+    size_t deltaSize;
+    unsigned char* delta = save(msx, true, &deltaSize);
+    unsigned long long expected = msx->stateHash();
+    for (int i = 0; i < 30; i++) msx->tick(i & 0x08 ? 0x02 : 0, 0);
+    const void* deltas[1] = {delta};
+    size_t deltaSizes[1] = {deltaSize};
+    bool loaded = msx->loadStateChain(base, baseSize, deltas, deltaSizes, 1);
+    bool same = loaded && msx->stateHash() == expected;
+    // the delta is rejected on another state (and the state is kept)
+    msx->tick(0, 0);
+    unsigned long long current = msx->stateHash();
+    bool rejected = !msx->loadState(delta, deltaSize) && msx->stateHash() == current;
+    printf("run-ahead %d, compression %s: chain %s, hash %s, delta on another state %s\n", runAhead, compression ? "on " : "off", loaded ? "loaded" : "REJECTED", same ? "same" : "DIFFERENT", rejected ? "rejected" : "ACCEPTED");
+    free(base);
+    free(delta);
+    msx->setRunAhead(0);
+    return same && rejected;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3) {
+        usage();
+        return 1;
+    }
+    int type;
+    if (0 == strcmp(argv[1], "sg1000")) {
+        type = TINYMSX_TYPE_SG1000;
+    } else if (0 == strcmp(argv[1], "msx")) {
+        type = TINYMSX_TYPE_MSX1;
+    } else {
+        usage();
+        return 1;
+    }
+    FILE* fp = fopen(argv[2], "rb");
+    if (!fp) {
+        puts("File not found");
+        return 1;
+    }
+    fseek(fp, 0, SEEK_END);
+    size_t romSize = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    void* rom = malloc(romSize);
+    if (!rom || romSize != fread(rom, 1, romSize, fp)) {
+        puts("Read error");
+        fclose(fp);
+        return 1;
+    }
+    fclose(fp);
+    TinyMSX msx(type, rom, romSize, 0x8000, TINYMSX_COLOR_MODE_RGB555);
+    if (msx.isMSX1Family() && !msx.loadBiosFromFile("../../bios/cbios_main_msx1.rom")) {
+        puts("load BIOS error");
+        return 1;
+    }
+    bool ok = true;
+    for (int runAhead = 0; runAhead <= 2; runAhead++) {
+        ok = testDeltaChain(&msx, runAhead, false) && ok;
+        ok = testDeltaChain(&msx, runAhead, true) && ok;
+    }
+    puts(ok ? "OK" : "NG");
+    free(rom);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../../src/vgmplayer.hpp"
+
+void usage() { puts("usage: vgmplay vgm-file wav-file"); }
+
+static void putLE(unsigned char* ptr, unsigned int value, int size)
+{
+    for (int i = 0; i < size; i++) ptr[i] = (value >> (i * 8)) & 0xFF;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3) {
+        usage();
+        return 1;
+    }
+    FILE* fp = fopen(argv[1], "rb");
+    if (!fp) {
+        puts("File not found");
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    unsigned char* data = (unsigned char*)malloc(size);
+    if (!data || size != (long)fread(data, 1, size, fp)) {
+        puts("Read error");
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    VgmPlayer player;
+    if (!player.load(data, size)) {
+        puts("Invalid VGM file");
+        free(data);
+        return -1;
+    }
+    fp = fopen(argv[2], "wb");
+    if (!fp) {
+        puts("Cannot open the output file");
+        free(data);
+        return -1;
+    }
+    unsigned char header[44];
+    fwrite(header, 1, sizeof(header), fp); // written after rendering
+    clock_t start = clock();
+    unsigned int total = 0;
+    short buffer[4096 * 2];
+    int n;
+    while (0 < (n = player.render(buffer, 4096, true))) {
+        fwrite(buffer, 4, n, fp);
+        total += n;
+    }
+    double sec = (double)(clock() - start) / CLOCKS_PER_SEC;
+    memcpy(&header[0], "RIFF", 4);
+    putLE(&header[4], 36 + total * 4, 4);
+    memcpy(&header[8], "WAVEfmt ", 8);
+    putLE(&header[16], 16, 4);
+    putLE(&header[20], 1, 2); // PCM
+    putLE(&header[22], 2, 2); // stereo
+    putLE(&header[24], VGM_SAMPLE_RATE, 4);
+    putLE(&header[28], VGM_SAMPLE_RATE * 4, 4);
+    putLE(&header[32], 4, 2);
+    putLE(&header[34], 16, 2);
+    memcpy(&header[36], "data", 4);
+    putLE(&header[40], total * 4, 4);
+    fseek(fp, 0, SEEK_SET);
+    fwrite(header, 1, sizeof(header), fp);
+    fclose(fp);
+    free(data);
+    printf("rendered %u samples (%.1f sec) in %.3f sec\n", total, (double)total / VGM_SAMPLE_RATE, sec);
+    return 0;
+}